@@ -28,23 +28,7 @@ BufferBX::BufferBX(std::size_t size, BufferType type, BufferUsage usage)
 
 BufferBX::~BufferBX()
 {
-	if (_hasHandle)
-	{
-		if (_type == BufferType::VERTEX)
-		{
-			if (_usage == BufferUsage::STATIC)
-				destroy(_handle.vertexBuffer);
-			else
-				destroy(_handle.dynamicVertexBuffer);
-		}
-		else
-		{
-			if (_usage == BufferUsage::STATIC)
-				destroy(_handle.indexBuffer);
-			else
-				destroy(_handle.dynamicIndexBuffer);
-		}
-	}
+	destroyHandle();
 	delete[] _data;
 
 #if CC_ENABLE_CACHE_TEXTURE_DATA
@@ -61,25 +45,49 @@ void BufferBX::usingDefaultStoredData(bool needDefaultStoredData)
 
 void BufferBX::setVertexLayout(const VertexLayout& vertexLayout)
 {
+	// should only be used for vertex buffer
+	if (_type != BufferType::VERTEX)
+		return;
+	VertexLayoutHandle layoutHandle = BGFX_INVALID_HANDLE;
+	const auto& layout = UtilsBX::getBXVertexLayout(vertexLayout, &layoutHandle);
+	_layoutHandle = layoutHandle;
 	if (_hasHandle)
 		return;
 	assert(_data && _bufferAllocated > 0);
-	// should only be used for vertex buffer
-	if (_type == BufferType::VERTEX)
+	CCLOG("allocate vertex buffer of size %d", _bufferAllocated);
+	if (_usage == BufferUsage::STATIC)
 	{
-		CCLOG("allocate vertex buffer of size %d", _bufferAllocated);
-		if (_usage == BufferUsage::STATIC)
-		{
-			_handle.vertexBuffer = createVertexBuffer(
-				copy(_data, _bufferAllocated), UtilsBX::toBXVertexLayout(vertexLayout));
-		}
-		else
-		{
-			_handle.dynamicVertexBuffer = createDynamicVertexBuffer(
-				copy(_data, _bufferAllocated), UtilsBX::toBXVertexLayout(vertexLayout));
-		}
-		_layout = vertexLayout;
-		_hasHandle = true;
+		_handle.vertexBuffer = createVertexBuffer(
+			copy(_data, _bufferAllocated), layout);
+	}
+	else
+	{
+		_handle.dynamicVertexBuffer = createDynamicVertexBuffer(
+			copy(_data, _bufferAllocated), layout);
+	}
+	// stride of the buffer is fixed by the layout used at creation
+	_layout = vertexLayout;
+	_hasHandle = true;
+}
+
+void BufferBX::setIndexFormat(IndexFormat indexFormat)
+{
+	if (_type != BufferType::INDEX)
+		return;
+	if (_indexFormatFixed)
+	{
+		CCASSERT(_indexFormat == indexFormat, "Index format of a buffer can't be changed.");
+		return;
+	}
+	_indexFormatFixed = true;
+	if (_indexFormat == indexFormat)
+		return;
+	_indexFormat = indexFormat;
+	if (_hasHandle)
+	{
+		// element size is fixed at creation
+		destroyHandle();
+		createIndexHandle();
 	}
 }
 
@@ -89,6 +97,8 @@ void BufferBX::apply(uint32_t start, uint32_t num, uint8_t stream, VertexLayoutH
 		return;
 	if (_type == BufferType::VERTEX)
 	{
+		if (!isValid(layout))
+			layout = _layoutHandle;
 		if (_usage == BufferUsage::STATIC)
 		{
 			const auto hdl = _handle.vertexBuffer;
@@ -127,15 +137,16 @@ void BufferBX::apply(uint8_t stream)
 		return;
 	if (_type == BufferType::VERTEX)
 	{
+		const auto layout = _layoutHandle;
 		if (_usage == BufferUsage::STATIC)
 		{
 			const auto hdl = _handle.vertexBuffer;
-			addThreadTask([=]() { setVertexBuffer(stream, hdl); });
+			addThreadTask([=]() { setVertexBuffer(stream, hdl, 0, UINT32_MAX, layout); });
 		}
 		else
 		{
 			const auto hdl = _handle.dynamicVertexBuffer;
-			addThreadTask([=]() { setVertexBuffer(stream, hdl); });
+			addThreadTask([=]() { setVertexBuffer(stream, hdl, 0, UINT32_MAX, layout); });
 		}
 	}
 	else
@@ -190,17 +201,7 @@ void BufferBX::updateData(void* data, std::size_t size)
 	{
 		// init index buffer
 		if (_type == BufferType::INDEX)
-		{
-			if (_usage == BufferUsage::STATIC)
-			{
-				_handle.indexBuffer = createIndexBuffer(copy(_data, _size));
-			}
-			else
-			{
-				_handle.dynamicIndexBuffer = createDynamicIndexBuffer(copy(_data, _size));
-			}
-			_hasHandle = true;
-		}
+			createIndexHandle();
 	}
 }
 
@@ -230,9 +231,50 @@ void BufferBX::updateSubData(void* data, std::size_t offset, std::size_t size)
 		}
 		else
 		{
-			update(_handle.dynamicIndexBuffer, offset / sizeof(uint16_t), copy(_data + offset, size));
+			update(_handle.dynamicIndexBuffer, offset / getIndexSize(), copy(_data + offset, size));
 		}
 	}
 }
 
+void BufferBX::createIndexHandle()
+{
+	const uint16_t flags = _indexFormat == IndexFormat::U_INT ? BGFX_BUFFER_INDEX32 : BGFX_BUFFER_NONE;
+	if (_usage == BufferUsage::STATIC)
+	{
+		_handle.indexBuffer = createIndexBuffer(copy(_data, _size), flags);
+	}
+	else
+	{
+		_handle.dynamicIndexBuffer = createDynamicIndexBuffer(copy(_data, _size), flags);
+	}
+	_hasHandle = true;
+}
+
+void BufferBX::destroyHandle()
+{
+	if (!_hasHandle)
+		return;
+	if (_type == BufferType::VERTEX)
+	{
+		if (_usage == BufferUsage::STATIC)
+			destroy(_handle.vertexBuffer);
+		else
+			destroy(_handle.dynamicVertexBuffer);
+	}
+	else
+	{
+		if (_usage == BufferUsage::STATIC)
+			destroy(_handle.indexBuffer);
+		else
+			destroy(_handle.dynamicIndexBuffer);
+	}
+	_handle.indexBuffer = BGFX_INVALID_HANDLE;
+	_hasHandle = false;
+}
+
+std::size_t BufferBX::getIndexSize() const
+{
+	return _indexFormat == IndexFormat::U_INT ? sizeof(uint32_t) : sizeof(uint16_t);
+}
+
 CC_BACKEND_END
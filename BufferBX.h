@@ -40,11 +40,27 @@ public:
 	 */
 	virtual void usingDefaultStoredData(bool needDefaultStoredData) override;
 
+	/**
+	 * Set vertex layout, the buffer is created with the first layout.
+	 * Later layouts only change the cached layout handle used by `apply`.
+	 * @param vertexLayout Specifies the vertex layout.
+	 */
 	void setVertexLayout(const VertexLayout& vertexLayout);
+	/**
+	 * Set element type of an index buffer, the buffer is recreated if it already has a handle.
+	 * Only the first call takes effect, the type can't change afterwards.
+	 * @param indexFormat Specifies the index type, either 16 bit integer or 32 bit integer.
+	 */
+	void setIndexFormat(IndexFormat indexFormat);
+	IndexFormat getIndexFormat() const { return _indexFormat; }
 	void apply(uint32_t start, uint32_t num, uint8_t stream, bgfx::VertexLayoutHandle layout = BGFX_INVALID_HANDLE);
 	void apply(uint8_t stream);
 
 private:
+	void createIndexHandle();
+	void destroyHandle();
+	std::size_t getIndexSize() const;
+
 #if CC_ENABLE_CACHE_TEXTURE_DATA
 	void reloadBuffer();
 	bool _bufferAlreadyFilled = false;
@@ -63,6 +79,9 @@ private:
 	std::size_t _bufferAllocated = 0;
 	char* _data = nullptr;
 	VertexLayout _layout;
+	bgfx::VertexLayoutHandle _layoutHandle = BGFX_INVALID_HANDLE;
+	IndexFormat _indexFormat = IndexFormat::U_SHORT;
+	bool _indexFormatFixed = false;
 	bool _needDefaultStoredData = true;
 };
 
@@ -1,6 +1,7 @@
 #include "renderer/CCRenderer.h"
 
 #include <algorithm>
+#include <unordered_map>
 
 #include "renderer/CCTrianglesCommand.h"
 #include "renderer/CCCustomCommand.h"
@@ -22,10 +23,68 @@
 #include "xxhash.h"
 
 #include "renderer/backend/Backend.h"
+#include "BufferBX.h"
 #define CC_USE_METAL
 
 NS_CC_BEGIN
 
+namespace
+{
+    // Storage of the batched triangle path when 32-bit indices are available.
+    // A batch can then hold more vertices than the 16-bit `_verts`/`_indices` allow,
+    // only batches which index past 65535 use 32-bit indices.
+    struct TriangleBatchStorage
+    {
+        static const int VBO_SIZE_32 = Renderer::VBO_SIZE * 4;
+        static const int INDEX_VBO_SIZE_32 = VBO_SIZE_32 * 6 / 4;
+        static const int MAX_INDEX_16 = 65535;
+
+        bool large = false;
+        // format of the batch being filled
+        bool index32 = false;
+        int vertexCapacity = Renderer::VBO_SIZE;
+        int indexCapacity = Renderer::INDEX_VBO_SIZE;
+        std::vector<V3F_C4B_T2F> verts;
+        std::vector<uint16_t> indices16;
+        std::vector<uint32_t> indices32;
+        // 32-bit index buffer paired with each 16-bit one, created on first use
+        std::unordered_map<backend::Buffer*, backend::Buffer*> indexBuffers32;
+
+        void init()
+        {
+            large = (bgfx::getCaps()->supported & BGFX_CAPS_INDEX32) != 0;
+            if (!large)
+                return;
+            vertexCapacity = VBO_SIZE_32;
+            indexCapacity = INDEX_VBO_SIZE_32;
+            verts.resize(vertexCapacity);
+            indices16.resize(indexCapacity);
+            indices32.resize(indexCapacity);
+        }
+
+        backend::Buffer* getIndexBuffer32(backend::Buffer* indexBuffer16)
+        {
+            auto& buffer = indexBuffers32[indexBuffer16];
+            if (!buffer)
+            {
+                const auto size = indexCapacity * sizeof(uint32_t);
+                buffer = backend::Device::getInstance()->newBuffer(size,
+                    backend::BufferType::INDEX, backend::BufferUsage::DYNAMIC);
+                static_cast<backend::BufferBX*>(buffer)->setIndexFormat(backend::IndexFormat::U_INT);
+            }
+            return buffer;
+        }
+
+        void releaseBuffers()
+        {
+            for (auto& it : indexBuffers32)
+                CC_SAFE_RELEASE(it.second);
+            indexBuffers32.clear();
+        }
+    };
+    TriangleBatchStorage batchStorage;
+}
+
 // helper
 static bool compareRenderCommand(RenderCommand* a, RenderCommand* b)
 {
@@ -160,6 +219,7 @@ Renderer::~Renderer()
 
 void Renderer::init()
 {
+    batchStorage.init();
     // Should invoke _triangleCommandBufferManager.init() first.
     _triangleCommandBufferManager.init();
     _vertexBuffer = _triangleCommandBufferManager.getVertexBuffer();
@@ -246,10 +306,10 @@ void Renderer::processRenderCommand(RenderCommand* command)
             auto cmd = static_cast<TrianglesCommand*>(command);
             
             // flush own queue when buffer is full
-            if(_queuedTotalVertexCount + cmd->getVertexCount() > VBO_SIZE || _queuedTotalIndexCount + cmd->getIndexCount() > INDEX_VBO_SIZE)
+            if(_queuedTotalVertexCount + cmd->getVertexCount() > batchStorage.vertexCapacity || _queuedTotalIndexCount + cmd->getIndexCount() > batchStorage.indexCapacity)
             {
-                CCASSERT(cmd->getVertexCount()>= 0 && cmd->getVertexCount() < VBO_SIZE, "VBO for vertex is not big enough, please break the data down or use customized render command");
-                CCASSERT(cmd->getIndexCount()>= 0 && cmd->getIndexCount() < INDEX_VBO_SIZE, "VBO for index is not big enough, please break the data down or use customized render command");
+                CCASSERT(cmd->getVertexCount()>= 0 && cmd->getVertexCount() < batchStorage.vertexCapacity, "VBO for vertex is not big enough, please break the data down or use customized render command");
+                CCASSERT(cmd->getIndexCount()>= 0 && cmd->getIndexCount() < batchStorage.indexCapacity, "VBO for index is not big enough, please break the data down or use customized render command");
                 drawBatchedTriangles();
 
                 _queuedTotalIndexCount = _queuedTotalVertexCount = 0;
@@ -517,22 +577,35 @@ void Renderer::setViewPort(int x, int y, unsigned int w, unsigned int h)
 
 void Renderer::fillVerticesAndIndices(const TrianglesCommand* cmd, unsigned int vertexBufferOffset)
 {
+    auto verts = batchStorage.large ? batchStorage.verts.data() : _verts;
     size_t vertexCount = cmd->getVertexCount();
-    memcpy(&_verts[_filledVertex], cmd->getVertices(), sizeof(V3F_C4B_T2F) * vertexCount);
+    memcpy(&verts[_filledVertex], cmd->getVertices(), sizeof(V3F_C4B_T2F) * vertexCount);
     
     // fill vertex, and convert them to world coordinates
     const Mat4& modelView = cmd->getModelView();
     for (size_t i=0; i < vertexCount; ++i)
     {
-        modelView.transformPoint(&(_verts[i + _filledVertex].vertices));
+        modelView.transformPoint(&(verts[i + _filledVertex].vertices));
     }
     
     // fill index
     const unsigned short* indices = cmd->getIndices();
     size_t indexCount = cmd->getIndexCount();
-    for (size_t i = 0; i < indexCount; ++i)
+    if (batchStorage.index32)
     {
-        _indices[_filledIndex + i] = vertexBufferOffset + _filledVertex + indices[i];
+        const auto dst = batchStorage.indices32.data() + _filledIndex;
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            dst[i] = vertexBufferOffset + _filledVertex + indices[i];
+        }
+    }
+    else
+    {
+        const auto dst = batchStorage.large ? batchStorage.indices16.data() : _indices;
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            dst[_filledIndex + i] = vertexBufferOffset + _filledVertex + indices[i];
+        }
     }
     
     _filledVertex += vertexCount;
@@ -564,6 +637,13 @@ void Renderer::drawBatchedTriangles()
     _filledVertex = 0;
     _filledIndex = 0;
 
+    // 16-bit indices are used unless the batch indexes past them
+    size_t vertexCount = 0;
+    for (const auto& cmd : _queuedTriangleCommands)
+        vertexCount += cmd->getVertexCount();
+    batchStorage.index32 = batchStorage.large
+        && vertexBufferFillOffset + vertexCount > TriangleBatchStorage::MAX_INDEX_16 + 1;
+
     for(const auto& cmd : _queuedTriangleCommands)
     {
         auto currentMaterialID = cmd->getMaterialID();
@@ -607,12 +687,29 @@ void Renderer::drawBatchedTriangles()
         firstCommand = false;
     }
     batchesTotal++;
+    void* verts = _verts;
+    void* indices = _indices;
+    size_t indexSize = sizeof(_indices[0]);
+    auto indexFormat = backend::IndexFormat::U_SHORT;
+    auto indexBuffer = _indexBuffer;
+    if (batchStorage.large)
+    {
+        verts = batchStorage.verts.data();
+        indices = batchStorage.indices16.data();
+    }
+    if (batchStorage.index32)
+    {
+        indices = batchStorage.indices32.data();
+        indexSize = sizeof(batchStorage.indices32[0]);
+        indexFormat = backend::IndexFormat::U_INT;
+        indexBuffer = batchStorage.getIndexBuffer32(_indexBuffer);
+    }
 #ifdef CC_USE_METAL
-    _vertexBuffer->updateSubData(_verts, vertexBufferFillOffset * sizeof(_verts[0]), _filledVertex * sizeof(_verts[0]));
-    _indexBuffer->updateSubData(_indices, indexBufferFillOffset * sizeof(_indices[0]), _filledIndex * sizeof(_indices[0]));
+    _vertexBuffer->updateSubData(verts, vertexBufferFillOffset * sizeof(_verts[0]), _filledVertex * sizeof(_verts[0]));
+    indexBuffer->updateSubData(indices, indexBufferFillOffset * indexSize, _filledIndex * indexSize);
 #else
-    _vertexBuffer->updateData(_verts, _filledVertex * sizeof(_verts[0]));
-    _indexBuffer->updateData(_indices,  _filledIndex * sizeof(_indices[0]));
+    _vertexBuffer->updateData(verts, _filledVertex * sizeof(_verts[0]));
+    indexBuffer->updateData(indices,  _filledIndex * indexSize);
 #endif
 
     /************** 2: Draw *************/
@@ -620,13 +717,13 @@ void Renderer::drawBatchedTriangles()
     {
         beginRenderPass(_triBatchesToDraw[i].cmd);
         _commandBuffer->setVertexBuffer(_vertexBuffer);
-        _commandBuffer->setIndexBuffer(_indexBuffer);
+        _commandBuffer->setIndexBuffer(indexBuffer);
         auto& pipelineDescriptor = _triBatchesToDraw[i].cmd->getPipelineDescriptor();
         _commandBuffer->setProgramState(pipelineDescriptor.programState);
         _commandBuffer->drawElements(backend::PrimitiveType::TRIANGLE,
-                                     backend::IndexFormat::U_SHORT,
+                                     indexFormat,
                                      _triBatchesToDraw[i].indicesToDraw,
-                                     _triBatchesToDraw[i].offset * sizeof(_indices[0]));
+                                     _triBatchesToDraw[i].offset * indexSize);
         _commandBuffer->endRenderPass();
 
         _drawnBatches++;
@@ -930,6 +1027,8 @@ Renderer::TriangleCommandBufferManager::~TriangleCommandBufferManager()
 
     for (auto& indexBuffer : _indexBufferPool)
         indexBuffer->release();
+
+    batchStorage.releaseBuffers();
 }
 
 void Renderer::TriangleCommandBufferManager::init()
@@ -968,11 +1067,11 @@ void Renderer::TriangleCommandBufferManager::createBuffer()
 {
     auto device = backend::Device::getInstance();
 
-    auto vertexBuffer = device->newBuffer(Renderer::VBO_SIZE * sizeof(_verts[0]), backend::BufferType::VERTEX, backend::BufferUsage::DYNAMIC);
+    auto vertexBuffer = device->newBuffer(batchStorage.vertexCapacity * sizeof(_verts[0]), backend::BufferType::VERTEX, backend::BufferUsage::DYNAMIC);
     if (!vertexBuffer)
         return;
 
-	const auto iSize = Renderer::INDEX_VBO_SIZE * sizeof(uint16_t);
+	const auto iSize = batchStorage.indexCapacity * sizeof(uint16_t);
     auto tmpData = malloc(iSize);
     if (!tmpData)
         return;
@@ -44,9 +44,67 @@ THE SOFTWARE.
 #include "renderer/backend/ProgramState.h"
 #include "renderer/backend/Device.h"
 #include "bgfx/bgfx.h"
+#include "DynamicAtlasBX.h"
+#include "TextureArrayCacheBX.h"
+#include "TextureBX.h"
+#include "TextureResidencyBX.h"
 
 NS_CC_BEGIN
 
+namespace
+{
+    using PackedLocation = backend::DynamicAtlasBX::Location;
+    struct PackedTexture
+    {
+        // null if the texture is not packed
+        Texture2D* texture = nullptr;
+        Vec2 origin;
+        PackedLocation location;
+    };
+
+    // the array program replaces the default program only
+    bool canUseArray(const backend::ProgramState* programState)
+    {
+        return programState != nullptr &&
+            programState->getProgram()->getProgramType() == backend::ProgramType::POSITION_TEXTURE_COLOR;
+    }
+
+    PackedTexture findPackedTexture(Texture2D* texture, bool allowArray)
+    {
+        PackedTexture packed;
+        if (texture == nullptr || texture->getBackendTexture() == nullptr)
+            return packed;
+        const auto backendTexture = texture->getBackendTexture();
+        if (const auto region = backend::DynamicAtlasBX::getInstance()->find(backendTexture))
+        {
+            packed.texture = region->page;
+            packed.origin = region->rect.origin;
+            packed.location.pageId = region->pageId;
+        }
+        else if (allowArray)
+        {
+            if (const auto region = backend::TextureArrayCacheBX::getInstance()->find(backendTexture))
+            {
+                packed.texture = region->array;
+                packed.location.arrayId = region->arrayId;
+                packed.location.layer = region->layer;
+            }
+        }
+        return packed;
+    }
+
+    // textures loaded from files can be evicted and reloaded
+    void setTextureFileSource(Texture2D* texture, const std::string& filename)
+    {
+        if (texture == nullptr || texture->getBackendTexture() == nullptr)
+            return;
+        auto backendTexture = static_cast<backend::Texture2DBX*>(texture->getBackendTexture());
+        if (!backendTexture->hasReloader())
+            backend::TextureResidencyBX::setFileSource(backendTexture,
+                FileUtils::getInstance()->fullPathForFilename(filename));
+    }
+}
+
 // MARK: create, init, dealloc
 Sprite* Sprite::createWithTexture(Texture2D *texture)
 {
@@ -180,6 +238,7 @@ bool Sprite::initWithFile(const std::string& filename)
     Texture2D *texture = _director->getTextureCache()->addImage(filename);
     if (texture)
     {
+        setTextureFileSource(texture, filename);
         Rect rect = Rect::ZERO;
         rect.size = texture->getContentSize();
         return initWithTexture(texture, rect);
@@ -201,7 +260,10 @@ bool Sprite::initWithFile(const std::string &filename, const Rect& rect)
 
     Texture2D *texture = _director->getTextureCache()->addImage(filename);
     if (texture)
+    {
+        setTextureFileSource(texture, filename);
         return initWithTexture(texture, rect);
+    }
 
     // don't release here.
     // when load texture failed, it's better to get a "transparent" sprite then a crashed program
@@ -308,6 +370,8 @@ Sprite::~Sprite()
     CC_SAFE_FREE(_trianglesIndex);
     CC_SAFE_RELEASE(_spriteFrame);
     CC_SAFE_RELEASE(_texture);
+    backend::DynamicAtlasBX::getInstance()->removeSprite(this);
+    backend::TextureArrayCacheBX::getInstance()->removeSprite(this);
 }
 
 /*
@@ -338,6 +402,7 @@ static unsigned char cc_2x2_white_image[] = {
 void Sprite::setTexture(const std::string &filename)
 {
     Texture2D *texture = Director::getInstance()->getTextureCache()->addImage(filename);
+    setTextureFileSource(texture, filename);
     setTexture(texture);
     _unflippedOffsetPositionFromCenter = Vec2::ZERO;
     Rect rect = Rect::ZERO;
@@ -459,8 +524,32 @@ void Sprite::updateProgramStateTexture()
     if (_texture == nullptr || _texture->getBackendTexture() == nullptr)
         return;
 
-    auto programState = _trianglesCommand.getPipelineDescriptor().programState;
-    programState->setTexture(_textureLocation, 0, _texture->getBackendTexture());
+    auto texture = _texture;
+    auto& pipelineDescriptor = _trianglesCommand.getPipelineDescriptor();
+    pipelineDescriptor.programState = _programState;
+    if (_renderMode == RenderMode::QUAD || _renderMode == RenderMode::SLICE9)
+    {
+        const auto packed = findPackedTexture(_texture, canUseArray(_programState));
+        if (packed.texture && packed.location == backend::DynamicAtlasBX::getInstance()->getSpriteLocation(this))
+        {
+            texture = packed.texture;
+            auto arrayProgramState = packed.location.arrayId != 0 ?
+                backend::TextureArrayCacheBX::getInstance()->getProgramState(this, packed.location.arrayId) : nullptr;
+            if (arrayProgramState)
+            {
+                // attributes are the same as the default program
+                auto vertexLayout = arrayProgramState->getVertexLayout();
+                if (!vertexLayout->isValid())
+                    *vertexLayout = *_programState->getVertexLayout();
+                // the array is bound to the state already
+                pipelineDescriptor.programState = arrayProgramState;
+                return;
+            }
+        }
+    }
+
+    auto programState = pipelineDescriptor.programState;
+    programState->setTexture(_textureLocation, 0, texture->getBackendTexture());
     auto alphaTexture = _texture->getAlphaTexture();
     if(alphaTexture && alphaTexture->getBackendTexture())
     {
@@ -847,7 +936,24 @@ void Sprite::setTextureCoords(const Rect& rectInPoints, V3F_C4B_T2F_Quad* outQua
     if (tex == nullptr)
         return;
 
-    const auto rectInPixels = CC_RECT_POINTS_TO_PIXELS(rectInPoints);
+    auto rectInPixels = CC_RECT_POINTS_TO_PIXELS(rectInPoints);
+
+    // texture may be packed into a page of the dynamic atlas or a layer of a texture array
+    uint16_t layer = 0;
+    bool inArray = false;
+    if (_renderMode == RenderMode::QUAD || _renderMode == RenderMode::SLICE9)
+    {
+        const auto packed = findPackedTexture(tex, canUseArray(_programState));
+        if (packed.texture)
+        {
+            tex = packed.texture;
+            rectInPixels.origin += packed.origin;
+            layer = packed.location.layer;
+            inArray = packed.location.arrayId != 0;
+        }
+        // location that texture coordinates are computed for
+        backend::DynamicAtlasBX::getInstance()->setSpriteLocation(this, packed.location);
+    }
 
     const float atlasWidth = (float)tex->getPixelsWide();
     const float atlasHeight = (float)tex->getPixelsHigh();
@@ -887,6 +993,12 @@ void Sprite::setTextureCoords(const Rect& rectInPoints, V3F_C4B_T2F_Quad* outQua
     if ((!_rectRotated && _flippedY) || (_rectRotated && _flippedX))
         std::swap(top, bottom);
 
+    if (inArray)
+    {
+        left = backend::TextureArrayCacheBX::encodeLayer(left, layer);
+        right = backend::TextureArrayCacheBX::encodeLayer(right, layer);
+    }
+
     if (_rectRotated)
     {
         outQuad->bl.texCoords.u = left;
@@ -1101,6 +1213,22 @@ void Sprite::draw(Renderer *renderer, const Mat4 &transform, uint32_t flags)
     if (_texture == nullptr || _texture->getBackendTexture() == nullptr)
         return;
     
+    auto texture = _texture;
+    if (_renderMode == RenderMode::QUAD || _renderMode == RenderMode::SLICE9)
+    {
+        // the texture may have been packed or evicted since coordinates were computed
+        const auto packed = findPackedTexture(_texture, canUseArray(_programState));
+        const bool usingArray = _trianglesCommand.getPipelineDescriptor().programState != _programState;
+        if (packed.location != backend::DynamicAtlasBX::getInstance()->getSpriteLocation(this) ||
+            (packed.location.arrayId != 0) != usingArray)
+        {
+            updatePoly();
+            updateProgramStateTexture();
+        }
+        if (packed.texture)
+            texture = packed.texture;
+    }
+
     //TODO: arnold: current camera can be a non-default one.
     setMVPMatrixUniform();
 
@@ -1120,7 +1248,7 @@ void Sprite::draw(Renderer *renderer, const Mat4 &transform, uint32_t flags)
 #endif
     {
         _trianglesCommand.init(_globalZOrder,
-                               _texture,
+                               texture,
                                _blendFunc,
                                _polyInfo.triangles,
                                transform,
@@ -1769,8 +1897,12 @@ void Sprite::setMVPMatrixUniform()
 {
     const auto& projectionMat = Director::getInstance()->getMatrix(MATRIX_STACK_TYPE::MATRIX_STACK_PROJECTION);
     auto programState = _trianglesCommand.getPipelineDescriptor().programState;
-    if (programState && _mvpMatrixLocation)
-        programState->setUniform(_mvpMatrixLocation, projectionMat.m, sizeof(projectionMat.m));
+    auto mvpMatrixLocation = _mvpMatrixLocation;
+    // drawn from a texture array
+    if (programState && programState != _programState)
+        mvpMatrixLocation = programState->getUniformLocation(backend::Uniform::MVP_MATRIX);
+    if (programState && mvpMatrixLocation)
+        programState->setUniform(mvpMatrixLocation, projectionMat.m, sizeof(projectionMat.m));
 }
 
 backend::ProgramState* Sprite::getProgramState() const
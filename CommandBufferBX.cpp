@@ -6,6 +6,13 @@
 #include "ProgramBX.h"
 #include "UtilsBX.h"
 #include "CallbackBX.h"
+#include "TextureUploaderBX.h"
+#include "DynamicAtlasBX.h"
+#include "TextureArrayCacheBX.h"
+#include "TextureResidencyBX.h"
+#include "TextureReadbackBX.h"
+#include "RenderTargetPoolBX.h"
+#include "UniformArenaBX.h"
 #include "base/ccMacros.h"
 #include "base/CCEventDispatcher.h"
 #include "base/CCEventType.h"
@@ -34,12 +41,22 @@ namespace
 				return static_cast<Texture2DBX*>(texture)->getHandle();
 			case TextureType::TEXTURE_CUBE:
 				return static_cast<TextureCubeBX*>(texture)->getHandle();
+			case TEXTURE_2D_ARRAY:
+				return static_cast<Texture2DArrayBX*>(texture)->getHandle();
 			default:
 				assert(false);
 			}
 		}
 		return BGFX_INVALID_HANDLE;
 	}
+	// render target which has not been drawn to since its storage was created
+	Texture2DBX* getUndefinedTarget(TextureBackend* texture)
+	{
+		if (!texture || texture->getTextureType() != TextureType::TEXTURE_2D)
+			return nullptr;
+		const auto target = static_cast<Texture2DBX*>(texture);
+		return target->isLevelDefined(0) ? nullptr : target;
+	}
 }
 
 CommandBufferBX::CommandBufferBX()
@@ -51,12 +68,8 @@ CommandBufferBX::CommandBufferBX()
 	_backToForegroundListener = EventListenerCustom::create(EVENT_RENDERER_RECREATED,
 		[this](EventCustom*)
 	{
-		const auto fbo = _generatedFBO;
-		addThreadTask([=]()
-		{
-			if (bgfx::isValid(fbo))
-				bgfx::destroy(fbo);
-		});
+		RenderTargetPoolBX::getInstance()->clear();
+		_attachments.clear();
 		_generatedFBO = BGFX_INVALID_HANDLE;
 	});
 	Director::getInstance()->getEventDispatcher()->addEventListenerWithFixedPriority(
@@ -66,12 +79,7 @@ CommandBufferBX::CommandBufferBX()
 
 CommandBufferBX::~CommandBufferBX()
 {
-	const auto fbo = _generatedFBO;
-	addThreadTask([=]()
-	{
-		if (bgfx::isValid(fbo))
-			bgfx::destroy(fbo);
-	});
+	// frame buffers are owned by RenderTargetPoolBX
 	CC_SAFE_RELEASE_NULL(_renderPipeline);
 	cleanResources();
 #if CC_ENABLE_CACHE_TEXTURE_DATA
@@ -83,6 +91,13 @@ CommandBufferBX::~CommandBufferBX()
 void CommandBufferBX::beginFrame()
 {
 	LOGFUNC;
+	TextureUploaderBX::getInstance()->process();
+	DynamicAtlasBX::getInstance()->process();
+	TextureArrayCacheBX::getInstance()->process();
+	TextureResidencyBX::getInstance()->process();
+	Texture2DBX::processStaging();
+	TextureReadbackBX::getInstance()->process();
+	RenderTargetPoolBX::getInstance()->process();
 	//_state = 0;
 	_state = BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_BLEND_FUNC(BGFX_STATE_BLEND_SRC_ALPHA, BGFX_STATE_BLEND_INV_SRC_ALPHA) | BGFX_STATE_BLEND_EQUATION(BGFX_STATE_BLEND_EQUATION_ADD);
 	addThreadTask([=]()
@@ -215,13 +230,15 @@ void CommandBufferBX::drawElements(PrimitiveType primitiveType, IndexFormat inde
 	_state &= ~BGFX_STATE_PT_MASK;
 	_state |= UtilsBX::toBXStatePrimitiveType(primitiveType);
 	_vertexBuffer->apply(0);
+	// index type is fixed by the first draw unless set when the buffer is created
+	_indexBuffer->setIndexFormat(indexType);
 	const auto start = offset / (indexType == IndexFormat::U_SHORT ? 2 : 4);
 	_indexBuffer->apply(start, count, 0);
 	if (NEED_LOG)
 	{
 		const auto p = (ProgramBX*)_programState->getProgram();
 		CCLOG("[%d] [drawElements] offset: %d, count: %d, pro: %d (%d)",
-			_currentView, offset / 2, count, p->getHandle().idx, (int)p->getProgramType());
+			_currentView, start, count, p->getHandle().idx, (int)p->getProgramType());
 		CCLOG("vp trans: %.2f, %.2f, %.2f, %.2f",
 			_vpTramsform.x, _vpTramsform.y, _vpTramsform.z, _vpTramsform.w);
 	}
@@ -261,32 +278,11 @@ void CommandBufferBX::endRenderPass()
 void CommandBufferBX::endFrame()
 {
 	LOGFUNC;
-	std::vector<bgfx::FrameBufferHandle> unused;
-	for (auto& old : _attachmentsOld)
-	{
-		bool find = false;
-		for (auto& val : _attachments)
-		{
-			if (std::memcmp(&val, &old, sizeof(val)) == 0)
-			{
-				find = true;
-				break;
-			}
-		}
-		if (!find)
-			unused.push_back(old.second);
-	}
-	_attachmentsOld = _attachments;
+	// frame buffers stay cached in the pool, views are assigned again next frame
 	_attachments.clear();
 	_generatedFBO = BGFX_INVALID_HANDLE;
-	addThreadTask([=]()
-	{
-		for (auto& fbo : unused)
-		{
-			bgfx::destroy(fbo);
-		}
-	});
 	_print = false;
+	UniformArenaBX::getInstance()->endFrame();
 }
 
 void CommandBufferBX::setLineWidth(float lineWidth)
@@ -442,15 +438,6 @@ void CommandBufferBX::applyRenderPassDescriptor(const RenderPassDescriptor& desc
 			color = getHandler(descirptor.colorAttachmentsTexture[0]);
 			attach.colorTexture = descirptor.colorAttachmentsTexture[0];
 		}
-		std::vector<bgfx::TextureHandle> textures;
-		if(bgfx::isValid(color))
-		{
-			textures.push_back(color);
-		}
-		if(bgfx::isValid(depth_stencil))
-		{
-			textures.push_back(depth_stencil);
-		}
 		attach.color = color;
 		attach.ds = depth_stencil;
 		size_t idx = 0;
@@ -466,7 +453,7 @@ void CommandBufferBX::applyRenderPassDescriptor(const RenderPassDescriptor& desc
 		if (idx == _attachments.size())
 		{
 			if (NEED_LOG) { CCLOG("create fbo %d: %d, %d", idx, color.idx, depth_stencil.idx); }
-			_generatedFBO = bgfx::createFrameBuffer(textures.size(), textures.data());
+			_generatedFBO = RenderTargetPoolBX::getInstance()->getFrameBuffer(color, depth_stencil);
 			_attachments.emplace_back(attach, _generatedFBO);
 			const auto view = _currentView;
 			const auto fbo = _generatedFBO;
@@ -523,6 +510,26 @@ void CommandBufferBX::applyRenderPassDescriptor(const RenderPassDescriptor& desc
 		clearStencilValue = descirptor.clearStencilValue;
 		if(NEED_LOG) { CCLOG("clear stencil: %.2f", descirptor.clearStencilValue); }
 	}
+	if (useGeneratedFBO)
+	{
+		// textures are created without data, new targets are cleared on GPU by their first pass
+		if (useColorAttachmentExternal)
+		{
+			if (auto target = getUndefinedTarget(descirptor.colorAttachmentsTexture[0]))
+			{
+				clear |= BGFX_CLEAR_COLOR;
+				target->markRendered();
+			}
+		}
+		const auto depthStencil = useDepthAttachmentExternal ?
+			descirptor.depthAttachmentTexture :
+			(useStencilAttachmentExternal ? descirptor.stencilAttachmentTexture : nullptr);
+		if (auto target = getUndefinedTarget(depthStencil))
+		{
+			clear |= BGFX_CLEAR_DEPTH | BGFX_CLEAR_STENCIL;
+			target->markRendered();
+		}
+	}
 	const auto view = _currentView;
 	if (!_scissorEnabled)
 	{
@@ -165,7 +165,6 @@ private:
 		bgfx::TextureHandle ds = BGFX_INVALID_HANDLE;
 	};
 	std::vector<std::pair<Attach, bgfx::FrameBufferHandle>> _attachments;
-	std::vector<std::pair<Attach, bgfx::FrameBufferHandle>> _attachmentsOld;
 
 	BufferBX* _vertexBuffer = nullptr;
 	ProgramState* _programState = nullptr;
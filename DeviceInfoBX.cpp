@@ -70,6 +70,11 @@ bool DeviceInfoBX::checkForFeatureSupported(FeatureType feature)
 	return false;
 }
 
+bool DeviceInfoBX::checkFormatNative(TextureFormat::Enum format)
+{
+	return (getCaps()->formats[format] & BGFX_CAPS_FORMAT_TEXTURE_2D) != 0;
+}
+
 bool DeviceInfoBX::checkPixelFormatFormat(PixelFormat pixelFormat)
 {
 	return getCaps()->formats[UtilsBX::toBXTextureFormat(pixelFormat)] != BGFX_CAPS_FORMAT_TEXTURE_NONE;
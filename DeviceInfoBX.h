@@ -2,6 +2,7 @@
 
 #include "renderer/backend/DeviceInfo.h"
 #include "renderer/backend/Types.h"
+#include "bgfx/bgfx.h"
 
 CC_BACKEND_BEGIN
 
@@ -48,6 +49,10 @@ public:
 	bool checkForFeatureSupported(FeatureType feature) override;
 
 	bool checkPixelFormatFormat(PixelFormat pixelFormat);
+	/**
+	 * Check if a texture format is sampled by hardware, formats emulated by bgfx are not.
+	 */
+	static bool checkFormatNative(bgfx::TextureFormat::Enum format);
 	uint8_t getGPUCount() const;
 private:
 	uint64_t _supported = 0;
@@ -0,0 +1,352 @@
+#include "DynamicAtlasBX.h"
+#include "TextureBX.h"
+#include "UtilsBX.h"
+#include "TextureResidencyBX.h"
+#include "renderer/CCTexture2D.h"
+#include "base/CCDirector.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+CC_BACKEND_BEGIN
+
+namespace
+{
+	bool intersects(uint16_t ax, uint16_t ay, uint16_t aw, uint16_t ah,
+		uint16_t bx, uint16_t by, uint16_t bw, uint16_t bh)
+	{
+		return ax < bx + bw && bx < ax + aw && ay < by + bh && by < ay + ah;
+	}
+	uint32_t currentFrame()
+	{
+		return Director::getInstance()->getTotalFrames();
+	}
+}
+
+DynamicAtlasBX* DynamicAtlasBX::getInstance()
+{
+	static DynamicAtlasBX ins;
+	return &ins;
+}
+
+DynamicAtlasBX::~DynamicAtlasBX()
+{
+	for (auto& page : _pages)
+		CC_SAFE_RELEASE(page.texture);
+	_pages.clear();
+	_regions.clear();
+	_spriteLocations.clear();
+}
+
+bool DynamicAtlasBX::isPackable(Texture2DBX* texture) const
+{
+	if (!_enabled || !texture)
+		return false;
+	uint32_t width, height;
+	texture->getSize(width, height);
+	if (width == 0 || height == 0 || width > _maxTextureSize || height > _maxTextureSize)
+		return false;
+	if (texture->getTextureFormat() != PixelFormat::RGBA8888 || texture->hasMipmaps()
+		|| texture->getTextureUsage() == TextureUsage::RENDER_TARGET)
+		return false;
+	// pages are clamped and linear filtered, textures sampled differently stay alone
+	const bool isPow2 = (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+	return texture->getSamplerFlag() == UtilsBX::toBXSampler(SamplerDescriptor(), false, isPow2);
+}
+
+bool DynamicAtlasBX::add(Texture2DBX* texture, const uint8_t* data)
+{
+	if (!data || !isPackable(texture))
+		return false;
+	uint32_t width, height;
+	texture->getSize(width, height);
+	if (_regions.find(texture) != _regions.end())
+	{
+		update(texture, 0, 0, width, height, data);
+		return true;
+	}
+	const auto paddedWidth = uint16_t(width + _padding * 2);
+	const auto paddedHeight = uint16_t(height + _padding * 2);
+	PackRect packed;
+	Page* target = nullptr;
+	for (auto& page : _pages)
+	{
+		if (insert(page, paddedWidth, paddedHeight, packed))
+		{
+			target = &page;
+			break;
+		}
+	}
+	if (!target && _pages.size() < _maxPages)
+	{
+		target = createPage();
+		if (target && !insert(*target, paddedWidth, paddedHeight, packed))
+			target = nullptr;
+	}
+	if (!target)
+		return false;
+
+	Entry entry;
+	entry.packed = packed;
+	entry.region.page = target->texture;
+	entry.region.pageId = target->id;
+	entry.region.rect = Rect(float(packed.x + _padding), float(packed.y + _padding),
+		float(width), float(height));
+	entry.region.lastUse = currentFrame();
+	_regions[texture] = entry;
+	update(texture, 0, 0, width, height, data);
+	return true;
+}
+
+void DynamicAtlasBX::update(Texture2DBX* texture, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+	const uint8_t* data)
+{
+	const auto it = _regions.find(texture);
+	if (it == _regions.end() || !data)
+		return;
+	auto& entry = it->second;
+	auto backend = entry.region.page->getBackendTexture();
+	uint32_t texWidth, texHeight;
+	texture->getSize(texWidth, texHeight);
+	const auto ox = uint32_t(entry.region.rect.origin.x);
+	const auto oy = uint32_t(entry.region.rect.origin.y);
+	if (x != 0 || y != 0 || width != texWidth || height != texHeight)
+	{
+		backend->updateSubData(ox + x, oy + y, width, height, 0, const_cast<uint8_t*>(data));
+		return;
+	}
+	// full update, extrude edges into the border so that linear filtering doesn't bleed
+	const auto paddedWidth = width + _padding * 2;
+	const auto paddedHeight = height + _padding * 2;
+	std::vector<uint8_t> padded(size_t(paddedWidth) * paddedHeight * 4);
+	for (uint32_t row = 0; row < paddedHeight; ++row)
+	{
+		const auto srcRow = uint32_t(std::min(std::max(int(row) - int(_padding), 0), int(height) - 1));
+		const auto src = data + size_t(srcRow) * width * 4;
+		auto dst = padded.data() + size_t(row) * paddedWidth * 4;
+		for (uint32_t i = 0; i < _padding; ++i)
+		{
+			std::memcpy(dst + i * 4, src, 4);
+			std::memcpy(dst + (_padding + width + i) * 4, src + (width - 1) * 4, 4);
+		}
+		std::memcpy(dst + _padding * 4, src, width * 4);
+	}
+	backend->updateSubData(ox - _padding, oy - _padding, paddedWidth, paddedHeight, 0, padded.data());
+}
+
+void DynamicAtlasBX::remove(Texture2DBX* texture)
+{
+	const auto it = _regions.find(texture);
+	if (it != _regions.end())
+		removeEntry(it);
+}
+
+const DynamicAtlasBX::Region* DynamicAtlasBX::find(TextureBackend* texture)
+{
+	if (_regions.empty())
+		return nullptr;
+	const auto it = _regions.find(texture);
+	if (it == _regions.end())
+		return nullptr;
+	it->second.region.lastUse = currentFrame();
+	return &it->second.region;
+}
+
+void DynamicAtlasBX::setSpriteLocation(const Sprite* sprite, const Location& location)
+{
+	if (location == Location())
+		_spriteLocations.erase(sprite);
+	else
+		_spriteLocations[sprite] = location;
+}
+
+DynamicAtlasBX::Location DynamicAtlasBX::getSpriteLocation(const Sprite* sprite) const
+{
+	if (_spriteLocations.empty())
+		return Location();
+	const auto it = _spriteLocations.find(sprite);
+	return it == _spriteLocations.end() ? Location() : it->second;
+}
+
+void DynamicAtlasBX::process()
+{
+	const auto frame = currentFrame();
+	// eviction scan is cheap but not needed every frame
+	if (_idleFrames > 0 && frame % 30 == 0)
+	{
+		for (auto it = _regions.begin(); it != _regions.end();)
+		{
+			auto next = std::next(it);
+			if (frame - it->second.region.lastUse > _idleFrames)
+				removeEntry(it);
+			it = next;
+		}
+	}
+	for (auto it = _pages.begin(); it != _pages.end();)
+	{
+		if (it->usedRects.empty())
+		{
+			CC_SAFE_RELEASE(it->texture);
+			it = _pages.erase(it);
+		}
+		else
+			++it;
+	}
+	if (!_pages.empty())
+	{
+		auto& page = _pages[_mergeCursor++ % _pages.size()];
+		if (page.hasReleased)
+			rebuildFreeRects(page);
+	}
+}
+
+float DynamicAtlasBX::getOccupancy() const
+{
+	if (_pages.empty())
+		return 0.f;
+	uint64_t used = 0;
+	for (auto& page : _pages)
+		used += page.usedArea;
+	return float(used) / (float(_pageSize) * _pageSize * _pages.size());
+}
+
+DynamicAtlasBX::Page* DynamicAtlasBX::createPage()
+{
+	auto texture = new (std::nothrow) Texture2D();
+	if (!texture)
+		return nullptr;
+	std::vector<uint8_t> zeros(size_t(_pageSize) * _pageSize * 4, 0);
+	if (!texture->initWithData(zeros.data(), zeros.size(), PixelFormat::RGBA8888,
+		_pageSize, _pageSize, Size(float(_pageSize), float(_pageSize))))
+	{
+		texture->release();
+		return nullptr;
+	}
+	TextureResidencyBX::getInstance()->setCategory(texture->getBackendTexture(),
+		TextureResidencyBX::Category::ATLAS);
+	Page page;
+	page.texture = texture;
+	page.id = _nextPageId++;
+	_pages.push_back(page);
+	rebuildFreeRects(_pages.back());
+	return &_pages.back();
+}
+
+bool DynamicAtlasBX::insert(Page& page, uint16_t width, uint16_t height, PackRect& result)
+{
+	// best short side fit
+	int bestScore = std::numeric_limits<int>::max();
+	const PackRect* best = nullptr;
+	for (auto& rect : page.freeRects)
+	{
+		if (rect.width < width || rect.height < height)
+			continue;
+		const int score = std::min(rect.width - width, rect.height - height);
+		if (score < bestScore)
+		{
+			bestScore = score;
+			best = &rect;
+		}
+	}
+	if (!best)
+		return false;
+	result.x = best->x;
+	result.y = best->y;
+	result.width = width;
+	result.height = height;
+	place(page, result);
+	return true;
+}
+
+void DynamicAtlasBX::place(Page& page, const PackRect& result)
+{
+	const auto width = result.width;
+	const auto height = result.height;
+	std::vector<PackRect> split;
+	for (auto it = page.freeRects.begin(); it != page.freeRects.end();)
+	{
+		const auto r = *it;
+		if (!intersects(r.x, r.y, r.width, r.height, result.x, result.y, width, height))
+		{
+			++it;
+			continue;
+		}
+		it = page.freeRects.erase(it);
+		if (result.x > r.x)
+			split.push_back({ r.x, r.y, uint16_t(result.x - r.x), r.height });
+		if (result.x + width < r.x + r.width)
+			split.push_back({ uint16_t(result.x + width), r.y, uint16_t(r.x + r.width - result.x - width), r.height });
+		if (result.y > r.y)
+			split.push_back({ r.x, r.y, r.width, uint16_t(result.y - r.y) });
+		if (result.y + height < r.y + r.height)
+			split.push_back({ r.x, uint16_t(result.y + height), r.width, uint16_t(r.y + r.height - result.y - height) });
+	}
+	page.freeRects.insert(page.freeRects.end(), split.begin(), split.end());
+	// drop rects contained in others
+	auto& rects = page.freeRects;
+	for (size_t i = 0; i < rects.size(); ++i)
+	{
+		for (size_t j = 0; j < rects.size(); ++j)
+		{
+			if (i == j)
+				continue;
+			const auto& a = rects[i];
+			const auto& b = rects[j];
+			if (a.x >= b.x && a.y >= b.y && a.x + a.width <= b.x + b.width && a.y + a.height <= b.y + b.height)
+			{
+				rects.erase(rects.begin() + i);
+				--i;
+				break;
+			}
+		}
+	}
+	page.usedRects.push_back(result);
+	page.usedArea += uint32_t(width) * height;
+}
+
+void DynamicAtlasBX::release(Page& page, const PackRect& rect)
+{
+	const auto it = std::find_if(page.usedRects.begin(), page.usedRects.end(), [&](const PackRect& r)
+	{
+		return r.x == rect.x && r.y == rect.y && r.width == rect.width && r.height == rect.height;
+	});
+	if (it == page.usedRects.end())
+		return;
+	page.usedRects.erase(it);
+	page.usedArea -= uint32_t(rect.width) * rect.height;
+	// usable right away, merged into maximal rects later in `process()`
+	page.freeRects.push_back(rect);
+	page.hasReleased = true;
+}
+
+void DynamicAtlasBX::rebuildFreeRects(Page& page)
+{
+	auto used = std::move(page.usedRects);
+	page.usedRects.clear();
+	page.usedArea = 0;
+	page.freeRects.clear();
+	page.freeRects.push_back({ 0, 0, uint16_t(_pageSize), uint16_t(_pageSize) });
+	page.hasReleased = false;
+	// regions stay where they are, only free space is recomputed
+	for (auto& rect : used)
+		place(page, rect);
+}
+
+DynamicAtlasBX::Page* DynamicAtlasBX::getPage(uint32_t id)
+{
+	for (auto& page : _pages)
+	{
+		if (page.id == id)
+			return &page;
+	}
+	return nullptr;
+}
+
+void DynamicAtlasBX::removeEntry(std::unordered_map<TextureBackend*, Entry>::iterator it)
+{
+	if (auto page = getPage(it->second.region.pageId))
+		release(*page, it->second.packed);
+	_regions.erase(it);
+}
+
+CC_BACKEND_END
@@ -0,0 +1,159 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include "math/CCGeometry.h"
+#include <unordered_map>
+#include <vector>
+
+NS_CC_BEGIN
+class Texture2D;
+class Sprite;
+NS_CC_END
+
+CC_BACKEND_BEGIN
+
+class TextureBackend;
+class Texture2DBX;
+
+/**
+ * Packs small textures into shared pages at runtime, so that sprites from
+ * separate images share a material and can be batched.
+ * Free space is tracked with maxrects, idle regions are evicted and free space
+ * of one page is merged in `process()`. Regions are never moved, so a page with
+ * scattered holes is only reclaimed once all of its regions are evicted.
+ */
+class DynamicAtlasBX
+{
+public:
+	struct Region
+	{
+		/** Page texture. */
+		Texture2D* page = nullptr;
+		/** Unique id of the page, never reused. */
+		uint32_t pageId = 0;
+		/** Region of the texture in page, in pixels. */
+		Rect rect;
+		uint32_t lastUse = 0;
+	};
+	/** Where texture coordinates of a sprite were computed, zero ids if it's not packed. */
+	struct Location
+	{
+		uint32_t pageId = 0;
+		uint32_t arrayId = 0;
+		uint16_t layer = 0;
+		bool operator==(const Location& other) const
+		{
+			return pageId == other.pageId && arrayId == other.arrayId && layer == other.layer;
+		}
+		bool operator!=(const Location& other) const { return !(*this == other); }
+	};
+
+	static DynamicAtlasBX* getInstance();
+	~DynamicAtlasBX();
+
+	/**
+	 * Pack a texture from its level 0 data.
+	 * @param texture Specifies the source texture.
+	 * @param data Specifies level 0 pixels.
+	 * @return true if the texture is packed.
+	 */
+	bool add(Texture2DBX* texture, const uint8_t* data);
+
+	/**
+	 * Forward an update of level 0 to the packed region.
+	 */
+	void update(Texture2DBX* texture, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+		const uint8_t* data);
+
+	/**
+	 * Remove a texture from atlas, sprites using it will fall back to the texture.
+	 */
+	void remove(Texture2DBX* texture);
+
+	/**
+	 * Find the packed region of a texture and mark it as used in current frame.
+	 * @return The region, null if the texture is not packed.
+	 */
+	const Region* find(TextureBackend* texture);
+
+	/**
+	 * Record the location that texture coordinates of a sprite are computed for.
+	 * Sprites compare it with the current one to see if the texture has moved.
+	 */
+	void setSpriteLocation(const Sprite* sprite, const Location& location);
+	/** Get recorded location of a sprite, zero ids if none. */
+	Location getSpriteLocation(const Sprite* sprite) const;
+	/** Should be invoked when a sprite is destroyed. */
+	void removeSprite(const Sprite* sprite) { _spriteLocations.erase(sprite); }
+
+	/**
+	 * Evict idle regions, release empty pages and merge free rects of one page
+	 * which had regions released. Should be invoked once per frame.
+	 */
+	void process();
+
+	/** Textures added later are not packed when disabled. */
+	void setEnabled(bool enabled) { _enabled = enabled; }
+	bool isEnabled() const { return _enabled; }
+	/** Max width and height of packed textures. */
+	void setMaxTextureSize(uint32_t size) { _maxTextureSize = size; }
+	uint32_t getMaxTextureSize() const { return _maxTextureSize; }
+	/** Number of frames before an unused region is evicted, 0 means never. */
+	void setIdleFrames(uint32_t frames) { _idleFrames = frames; }
+	uint32_t getIdleFrames() const { return _idleFrames; }
+
+	size_t getNumPages() const { return _pages.size(); }
+	size_t getNumRegions() const { return _regions.size(); }
+	/** Ratio of used area in all pages. */
+	float getOccupancy() const;
+
+private:
+	DynamicAtlasBX() = default;
+
+	struct PackRect
+	{
+		uint16_t x = 0;
+		uint16_t y = 0;
+		uint16_t width = 0;
+		uint16_t height = 0;
+	};
+	struct Page
+	{
+		Texture2D* texture = nullptr;
+		uint32_t id = 0;
+		uint32_t usedArea = 0;
+		std::vector<PackRect> freeRects;
+		std::vector<PackRect> usedRects;
+		// released rects are not merged into maximal rects yet
+		bool hasReleased = false;
+	};
+	struct Entry
+	{
+		Region region;
+		PackRect packed;
+	};
+
+	bool isPackable(Texture2DBX* texture) const;
+	Page* createPage();
+	bool insert(Page& page, uint16_t width, uint16_t height, PackRect& result);
+	void place(Page& page, const PackRect& rect);
+	void release(Page& page, const PackRect& rect);
+	void rebuildFreeRects(Page& page);
+	Page* getPage(uint32_t id);
+	void removeEntry(std::unordered_map<TextureBackend*, Entry>::iterator it);
+
+	std::unordered_map<TextureBackend*, Entry> _regions;
+	// only packed sprites are recorded
+	std::unordered_map<const Sprite*, Location> _spriteLocations;
+	std::vector<Page> _pages;
+	uint32_t _nextPageId = 1;
+	size_t _mergeCursor = 0;
+	bool _enabled = true;
+	uint32_t _maxTextureSize = 128;
+	uint32_t _pageSize = 1024;
+	uint32_t _maxPages = 4;
+	uint32_t _idleFrames = 600;
+	// border around regions, edges are extruded into it
+	uint32_t _padding = 2;
+};
+
+CC_BACKEND_END
@@ -0,0 +1,147 @@
+#include "ImageUtilsBX.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_USE_SSE2 1
+#else
+#define IMAGE_USE_SSE2 0
+#endif
+
+CC_BACKEND_BEGIN
+
+namespace
+{
+	void downsampleRowScalar(const uint8_t* row0, const uint8_t* row1, uint32_t srcWidth,
+		uint32_t bpp, uint8_t* dst, uint32_t dstBegin, uint32_t dstWidth)
+	{
+		for (uint32_t x = dstBegin; x < dstWidth; ++x)
+		{
+			const uint32_t x0 = std::min(x * 2, srcWidth - 1) * bpp;
+			const uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1) * bpp;
+			for (uint32_t c = 0; c < bpp; ++c)
+			{
+				const uint32_t sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+				dst[x * bpp + c] = uint8_t((sum + 2) >> 2);
+			}
+		}
+	}
+
+#if IMAGE_USE_SSE2
+	// 4 destination pixels of 4 bytes per iteration
+	uint32_t downsampleRowSSE2(const uint8_t* row0, const uint8_t* row1, uint32_t srcWidth,
+		uint8_t* dst, uint32_t dstWidth)
+	{
+		if (srcWidth < 2)
+			return 0;
+		const uint32_t n = std::min(dstWidth, srcWidth / 2) & ~3u;
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		for (uint32_t x = 0; x < n; x += 4)
+		{
+			const __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+			const __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16));
+			const __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+			const __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16));
+			// vertical sum in 16 bits, each register holds 2 pixel pairs
+			const __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+			const __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+			const __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+			const __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+			// horizontal sum of neighbour pixels
+			const __m128i h0 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+			const __m128i h1 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+			const __m128i r0 = _mm_srli_epi16(_mm_add_epi16(h0, two), 2);
+			const __m128i r1 = _mm_srli_epi16(_mm_add_epi16(h1, two), 2);
+			_mm_storeu_si128((__m128i*)(dst + x * 4), _mm_packus_epi16(r0, r1));
+		}
+		return n;
+	}
+#endif
+}
+
+void ImageUtilsBX::flipRows(uint8_t* data, size_t pitch, size_t rows)
+{
+	for (size_t i = 0; i < rows / 2; ++i)
+	{
+		auto a = data + i * pitch;
+		auto b = data + (rows - 1 - i) * pitch;
+		size_t n = 0;
+#if IMAGE_USE_SSE2
+		for (; n + 16 <= pitch; n += 16)
+		{
+			const __m128i va = _mm_loadu_si128((const __m128i*)(a + n));
+			const __m128i vb = _mm_loadu_si128((const __m128i*)(b + n));
+			_mm_storeu_si128((__m128i*)(a + n), vb);
+			_mm_storeu_si128((__m128i*)(b + n), va);
+		}
+#endif
+		for (; n < pitch; ++n)
+			std::swap(a[n], b[n]);
+	}
+}
+
+uint8_t ImageUtilsBX::getNumMips(uint32_t width, uint32_t height)
+{
+	uint32_t size = std::max(width, height);
+	uint8_t num = 1;
+	while (size > 1)
+	{
+		size >>= 1;
+		++num;
+	}
+	return num;
+}
+
+void ImageUtilsBX::downsample(const uint8_t* src, uint32_t width, uint32_t height,
+	uint32_t bytesPerPixel, uint8_t* dst)
+{
+	const uint32_t dstWidth = std::max(width / 2, 1u);
+	const uint32_t dstHeight = std::max(height / 2, 1u);
+	const uint32_t pitch = width * bytesPerPixel;
+	for (uint32_t y = 0; y < dstHeight; ++y)
+	{
+		const auto row0 = src + std::min(y * 2, height - 1) * pitch;
+		const auto row1 = src + std::min(y * 2 + 1, height - 1) * pitch;
+		const auto out = dst + y * dstWidth * bytesPerPixel;
+		uint32_t done = 0;
+#if IMAGE_USE_SSE2
+		if (bytesPerPixel == 4)
+			done = downsampleRowSSE2(row0, row1, width, out, dstWidth);
+#endif
+		downsampleRowScalar(row0, row1, width, bytesPerPixel, out, done, dstWidth);
+	}
+}
+
+std::vector<uint8_t> ImageUtilsBX::generateMipmaps(const uint8_t* src, uint32_t width, uint32_t height,
+	uint32_t bytesPerPixel, std::vector<size_t>& offsets)
+{
+	offsets.clear();
+	const auto numMips = getNumMips(width, height);
+	size_t total = 0;
+	uint32_t w = width;
+	uint32_t h = height;
+	for (uint8_t i = 1; i < numMips; ++i)
+	{
+		w = std::max(w / 2, 1u);
+		h = std::max(h / 2, 1u);
+		offsets.push_back(total);
+		total += size_t(w) * h * bytesPerPixel;
+	}
+	std::vector<uint8_t> ret(total);
+	const uint8_t* prev = src;
+	w = width;
+	h = height;
+	for (uint8_t i = 1; i < numMips; ++i)
+	{
+		auto out = ret.data() + offsets[i - 1];
+		downsample(prev, w, h, bytesPerPixel, out);
+		prev = out;
+		w = std::max(w / 2, 1u);
+		h = std::max(h / 2, 1u);
+	}
+	return ret;
+}
+
+CC_BACKEND_END
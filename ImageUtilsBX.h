@@ -0,0 +1,47 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+CC_BACKEND_BEGIN
+
+class ImageUtilsBX
+{
+public:
+	/**
+	 * Get number of mip levels of a full chain.
+	 */
+	static uint8_t getNumMips(uint32_t width, uint32_t height);
+
+	/**
+	 * Downsample an image to half size with a 2x2 box filter, odd edges are clamped.
+	 * @param src Specifies source pixels, tightly packed.
+	 * @param width,height Specifies size of source image.
+	 * @param bytesPerPixel Specifies pixel size, each channel is 8 bits.
+	 * @param dst Specifies destination pixels of size max(width/2,1) x max(height/2,1).
+	 */
+	static void downsample(const uint8_t* src, uint32_t width, uint32_t height,
+		uint32_t bytesPerPixel, uint8_t* dst);
+
+	/**
+	 * Generate mip levels 1..n of an image.
+	 * @param src Specifies level 0 pixels, tightly packed.
+	 * @param width,height Specifies size of level 0.
+	 * @param bytesPerPixel Specifies pixel size, each channel is 8 bits.
+	 * @param offsets Receives byte offset of each level in the result, starting from level 1.
+	 * @return Pixels of all generated levels in one block.
+	 */
+	static std::vector<uint8_t> generateMipmaps(const uint8_t* src, uint32_t width, uint32_t height,
+		uint32_t bytesPerPixel, std::vector<size_t>& offsets);
+
+	/**
+	 * Flip an image vertically in place.
+	 * @param data Specifies pixels.
+	 * @param pitch Specifies size of a row in bytes.
+	 * @param rows Specifies number of rows.
+	 */
+	static void flipRows(uint8_t* data, size_t pitch, size_t rows);
+};
+
+CC_BACKEND_END
@@ -2,10 +2,14 @@
 #include "renderer/backend/Texture.h"
 #include "ShaderModuleBX.h"
 #include "TextureBX.h"
+#include "UniformArenaBX.h"
 #include "UtilsBX.h"
 #include "base/CCConsole.h"
 #include "3d/CC3DProgramInfo.h"
 #include "CCDirector.h"
+#include <algorithm>
+#include <cstring>
+#include <tuple>
 #include <unordered_set>
 
 using namespace bgfx;
@@ -77,6 +81,38 @@ ProgramBX::ProgramBX(const std::string& vertexShader, const std::string& fragmen
 #endif
 }
 
+ProgramBX::ProgramBX(const std::string& vertexShader, const std::string& fragmentShader,
+	ShaderModuleBX* vertexModule, ShaderModuleBX* fragmentModule)
+: Program(vertexShader, fragmentShader)
+{
+	_handle = BGFX_INVALID_HANDLE;
+	_vertexShaderModule = vertexModule;
+	_fragmentShaderModule = fragmentModule;
+	CC_SAFE_RETAIN(_vertexShaderModule);
+	CC_SAFE_RETAIN(_fragmentShaderModule);
+	if (_vertexShaderModule
+		&& _fragmentShaderModule
+		&& isValid(_vertexShaderModule->getHandle())
+		&& isValid(_fragmentShaderModule->getHandle()))
+	{
+		compileProgram();
+		if (isValid(_handle))
+		{
+			computeUniformInfos();
+			computeLocations();
+		}
+	}
+#if CC_ENABLE_CACHE_TEXTURE_DATA
+	_backToForegroundListener = EventListenerCustom::create(EVENT_RENDERER_RECREATED,
+		[this](EventCustom*)
+	{
+		this->reloadProgram();
+	});
+	Director::getInstance()->getEventDispatcher()->addEventListenerWithFixedPriority(
+		_backToForegroundListener, -1);
+#endif
+}
+
 ProgramBX::~ProgramBX()
 {
 	CC_SAFE_RELEASE(_vertexShaderModule);
@@ -188,89 +224,78 @@ const std::unordered_map<std::string, UniformInfo>& ProgramBX::getAllActiveUnifo
 }
 
 void ProgramBX::setUniformAsInt(const std::string& name)
+{
+	if (markUniformAsInt(name))
+		buildUploadTable();
+}
+
+bool ProgramBX::markUniformAsInt(const std::string& name)
 {
 	// use UniformInfo::needConvert
+	bool found = false;
 	const auto it1 = _vertInfos.find(name);
 	if (it1 != _vertInfos.end())
+	{
 		it1->second.needConvert = true;
+		found = true;
+	}
 	const auto it2 = _fragInfos.find(name);
 	if (it2 != _fragInfos.end())
+	{
 		it2->second.needConvert = true;
+		found = true;
+	}
 	const auto it3 = _infos.find(name);
 	if (it3 != _infos.end())
 		it3->second.needConvert = true;
+	return found;
 }
 
 void ProgramBX::applyUniformBuffer(const char* vertBuffer, const char* fragBuffer)
 {
-	if (!isValid(_handle))
+	if (!isValid(_handle) || !_uploads)
+		return;
+	if (!vertBuffer && !fragBuffer)
 		return;
+	// buffers are copied so that later changes of the program state don't affect this draw
+	const auto vertSize = vertBuffer ? _vertBufferSize : 0;
+	const auto fragSize = fragBuffer ? _fragBufferSize : 0;
+	const auto data = UniformArenaBX::getInstance()->allocate(vertSize + fragSize);
+	const char* vert = nullptr;
+	const char* frag = nullptr;
 	if (vertBuffer)
 	{
-		for(auto& it : _vertInfos)
-		{
-			if (it.second.type != UniformType::Sampler)
-			{
-				const UniformHandle hdl = { uint16_t(it.second.location) };
-				const auto count = it.second.count;
-				const auto bufferOffset = it.second.bufferOffset;
-				if (!it.second.needConvert)
-				{
-					addThreadTask([=]()
-					{
-						setUniform(hdl, vertBuffer + bufferOffset, count);
-					});
-				}
-				else
-				{
-					// convert int to float since bgfx only supports float
-					const auto buf = new float[count]();
-					std::shared_ptr<float> ptr(buf, std::default_delete<float[]>());
-					const auto arr = (int32_t*)(vertBuffer + bufferOffset);
-					for (int i = 0; i < count; ++i)
-						buf[i] = float(arr[i]);
-					addThreadTask([=]()
-					{
-						setUniform(hdl, ptr.get(), count);
-					});
-				}
-			}
-		}
+		std::memcpy(data, vertBuffer, vertSize);
+		vert = data;
 	}
 	if (fragBuffer)
 	{
-		for (auto& it : _fragInfos)
-		{
-			if (it.second.type != UniformType::Sampler)
-			{
-				const UniformHandle hdl = { uint16_t(it.second.location) };
-				const auto count = it.second.count;
-				const auto bufferOffset = it.second.bufferOffset;
-				if (!it.second.needConvert)
-				{
-					addThreadTask([=]()
-					{
-						setUniform(hdl, fragBuffer + bufferOffset, count);
-					});
-				}
-				else
-				{
-					// convert int to float
-					const auto buf = new float[count]();
-					std::shared_ptr<float> ptr(buf, std::default_delete<float[]>());
-					const auto arr = (int32_t*)(fragBuffer + bufferOffset);
-					for (int i = 0; i < count; ++i)
-						buf[i] = float(arr[i]);
-					//setUniform(hdl, buf, count);
-					addThreadTask([=]()
-					{
-						setUniform(hdl, ptr.get(), count);
-					});
-					//delete[] buf;
-				}
-			}
-		}
+		std::memcpy(data + vertSize, fragBuffer, fragSize);
+		frag = data + vertSize;
 	}
+	// all uniforms of a draw are set in one task
+	const auto uploads = _uploads;
+	addThreadTask([=]()
+	{
+		if (vert)
+			uploadUniforms(uploads->vert, vert);
+		if (frag)
+			uploadUniforms(uploads->frag, frag);
+	});
+}
+
+void ProgramBX::uploadUniforms(const std::vector<UniformUpload>& uploads, const char* buffer)
+{
+	// int uniforms are already converted by ProgramState
+	for (auto& upload : uploads)
+		setUniform(upload.handle, buffer + upload.offset, upload.count);
+}
+
+bool ProgramBX::isUniformAsInt(ShaderStage stage, int offset) const
+{
+	// only a few uniforms are ints
+	const auto& offsets = stage == ShaderStage::VERTEX ? _vertIntOffsets : _fragIntOffsets;
+	return std::find(offsets.begin(), offsets.end(), offset) != offsets.end();
 }
 
 void ProgramBX::applyUniformTextures(
@@ -287,26 +312,32 @@ void ProgramBX::applyUniformTextures(
 			for (size_t i = 0; i < it.second.slot.size(); ++i)
 			{
 				TextureHandle t = BGFX_INVALID_HANDLE;
+				uint32_t flags = 0;
 				const auto tex = it.second.textures[i];
 				const auto slot = it.second.slot[i];
 				switch (tex->getTextureType())
 				{
 				case TextureType::TEXTURE_2D:
-					t = ((Texture2DBX*)tex)->getHandle();
-					((Texture2DBX*)tex)->apply(slot);
+					t = ((Texture2DBX*)tex)->apply(slot);
+					flags = ((Texture2DBX*)tex)->getSamplerFlag();
 					break;
 				case TextureType::TEXTURE_CUBE:
-					t = ((TextureCubeBX*)tex)->getHandle();
-					((TextureCubeBX*)tex)->apply(slot);
+					t = ((TextureCubeBX*)tex)->apply(slot);
+					flags = ((TextureCubeBX*)tex)->getSamplerFlag();
+					break;
+				case TEXTURE_2D_ARRAY:
+					t = ((Texture2DArrayBX*)tex)->apply(slot);
+					flags = ((Texture2DArrayBX*)tex)->getSamplerFlag();
 					break;
 				default: ;
 				}
 				if(!isValid(t))
 					continue;
 				const auto stage = uint8_t(it.second.slot[i]);
+				// sampler state is set per draw, changing it doesn't touch the texture
 				addThreadTask([=]()
 				{
-					setTexture(stage, hdl, t);
+					setTexture(stage, hdl, t, flags);
 				});
 			}
 		}		
@@ -438,7 +469,7 @@ void ProgramBX::computeUniformInfos()
 					inf.bufferOffset = offset;
 					offset += inf.size;
 				}
-				_vertInfos[name] = inf;
+				_fragInfos[name] = inf;
 			}
 			else
 			{
@@ -480,7 +511,7 @@ void ProgramBX::computeUniformInfos()
 			UniformLocation loc;
 			loc.shaderStage = ShaderStage::FRAGMENT;
 			if (it.second.type == UniformType::Sampler)
-				loc.location[0] = it.second.location;
+				loc.location[1] = it.second.location;
 			else
 				loc.location[1] = it.second.bufferOffset;
 			_locations[it.first] = loc;
@@ -492,10 +523,45 @@ void ProgramBX::computeUniformInfos()
 	setBuiltinUniform(UNIFORM_NAME_EFFECT_TYPE, EFFECT_TYPE);
 	setBuiltinUniform(UNIFORM_NAME_TEXTURE, TEXTURE);
 	setBuiltinUniform(UNIFORM_NAME_TEXTURE1, TEXTURE1);
-	// some uniforms are set as int
-	setUniformAsInt(UNIFORM_NAME_EFFECT_TYPE);
-	setUniformAsInt("u_has_alpha");
-	setUniformAsInt("u_has_light_map");
+	// some uniforms are set as int, the table is built once after
+	markUniformAsInt(UNIFORM_NAME_EFFECT_TYPE);
+	markUniformAsInt("u_has_alpha");
+	markUniformAsInt("u_has_light_map");
+	buildUploadTable();
+}
+
+void ProgramBX::buildUploadTable()
+{
+	auto table = std::make_shared<UploadTable>();
+	_vertIntOffsets.clear();
+	_fragIntOffsets.clear();
+	const std::tuple<const std::unordered_map<std::string, UniformInfo>*, std::vector<UniformUpload>*, std::vector<int>*> stages[] = {
+		std::make_tuple(&_vertInfos, &table->vert, &_vertIntOffsets),
+		std::make_tuple(&_fragInfos, &table->frag, &_fragIntOffsets),
+	};
+	for (auto& stage : stages)
+	{
+		const auto uploads = std::get<1>(stage);
+		for (auto& it : *std::get<0>(stage))
+		{
+			auto& info = it.second;
+			if (info.type == UniformType::Sampler)
+				continue;
+			UniformUpload upload;
+			upload.handle = { uint16_t(info.location) };
+			upload.count = uint16_t(info.count);
+			upload.offset = uint32_t(info.bufferOffset);
+			uploads->push_back(upload);
+			if (info.needConvert)
+				std::get<2>(stage)->push_back(info.bufferOffset);
+		}
+		// walk the buffer in order
+		std::sort(uploads->begin(), uploads->end(), [](const UniformUpload& a, const UniformUpload& b)
+		{
+			return a.offset < b.offset;
+		});
+	}
+	_uploads = table;
 }
 
 void ProgramBX::computeLocations()
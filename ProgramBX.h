@@ -3,6 +3,7 @@
 #include "renderer/backend/RenderPipelineDescriptor.h"
 #include "base/CCEventListenerCustom.h"
 #include "bgfx/bgfx.h"
+#include <memory>
 
 CC_BACKEND_BEGIN
 
@@ -22,6 +23,15 @@ public:
 		const std::string& varying,
 		const std::vector<std::string>& defines = {},
 		const std::vector<std::string>& includes = {});
+	/**
+	 * @param vertexShader,fragmentShader Specifes shader sources.
+	 * @param vertexModule,fragmentModule Specifes compiled shaders, which can be shared with other programs.
+	 */
+	ProgramBX(
+		const std::string& vertexShader,
+		const std::string& fragmentShader,
+		ShaderModuleBX* vertexModule,
+		ShaderModuleBX* fragmentModule);
 	~ProgramBX();
 
 	/**
@@ -30,6 +40,12 @@ public:
 	 */
 	bgfx::ProgramHandle getHandle() const { return _handle; }
 
+	/**
+	 * Set the type of a program not created by ProgramCache, programs of custom type are not batched.
+	 * @param type Specifies a built-in type with the same uniforms and attributes.
+	 */
+	void setBuiltinType(ProgramType type) { setProgramType(type); }
+
 	/**
 	 * Get uniform location by name.
 	 * @param uniform Specifies the uniform name.
@@ -97,7 +113,17 @@ public:
 	 */
 	const std::unordered_map<std::string, UniformInfo>& getAllActiveUniformInfo(ShaderStage stage) const override;
 
+	/**
+	 * Mark a uniform as int, `ProgramState` stores it converted to float since bgfx only supports float.
+	 * @param name Specifies the uniform name.
+	 */
 	void setUniformAsInt(const std::string& name);
+	/**
+	 * Check if uniform data at an offset of a stage buffer is set as int.
+	 * @param stage Specifies the shader stage, either VERTEX or FRAGMENT.
+	 * @param offset Specifies the offset in the uniform buffer.
+	 */
+	bool isUniformAsInt(ShaderStage stage, int offset) const;
 
 	void applyUniformBuffer(const char* vertBuffer, const char* fragBuffer);
 	void applyUniformTextures(
@@ -105,11 +131,27 @@ public:
 		const std::unordered_map<int, TextureInfo>& fragTextures);
 
 private:
+	// uniform data copied from a stage buffer to bgfx
+	struct UniformUpload
+	{
+		bgfx::UniformHandle handle;
+		uint16_t count;
+		uint32_t offset;
+	};
+	struct UploadTable
+	{
+		std::vector<UniformUpload> vert;
+		std::vector<UniformUpload> frag;
+	};
+
 	void compileProgram();
 	//bool getAttributeLocation(const std::string& attributeName, unsigned int& location) const;
 	void computeUniformInfos();
 	void computeLocations();
 	void setBuiltinUniform(const std::string& name, Uniform type);
+	bool markUniformAsInt(const std::string& name);
+	void buildUploadTable();
+	static void uploadUniforms(const std::vector<UniformUpload>& uploads, const char* buffer);
 #if CC_ENABLE_CACHE_TEXTURE_DATA
 	virtual void reloadProgram();
 	virtual int getMappedLocation(int location) const override { return location; }
@@ -125,6 +167,11 @@ private:
 	std::unordered_map<std::string, UniformInfo> _fragInfos;
 	std::unordered_map<std::string, UniformInfo> _infos;
 	std::unordered_map<std::string, UniformLocation> _locations;
+	// shared with render thread tasks, replaced instead of modified
+	std::shared_ptr<const UploadTable> _uploads;
+	// buffer offsets of int uniforms
+	std::vector<int> _vertIntOffsets;
+	std::vector<int> _fragIntOffsets;
 	std::size_t _vertBufferSize = 0;
 	std::size_t _fragBufferSize = 0;
 	UniformLocation _builtinUniformLocation[UNIFORM_MAX];
@@ -4,6 +4,9 @@
 #include "base/ccMacros.h"
 #include "base/CCConfiguration.h"
 #include "ProgramBX.h"
+#include "ProgramLoaderBX.h"
+#include "ProgramVariantsBX.h"
+#include "ShaderPackBX.h"
 
 namespace std
 {
@@ -84,36 +87,33 @@ namespace
 #include "shaders/TERRAIN_3D.vary"
 #include "shaders/TERRAIN_3D.vert"
 
-	ProgramBX* newProgram(const std::string& varying, const std::string& vert, const std::string& frag)
-    {
-		return new ProgramBX(vert, frag, varying);
-    }
-	ProgramBX* newProgram(const std::string& varying, const std::string& vert, const std::string& frag,
-		const std::vector<std::string>& def)
-    {
-		return new ProgramBX(vert, frag, varying, def);
-    }
+	ProgramLoaderBX::Source newSource(const std::string& varying, const std::string& vert, const std::string& frag,
+		const std::vector<std::string>& def = {})
+	{
+		return { vert, frag, varying, def };
+	}
+	// defines are passed to the shaderc preprocessor as NAME=value
 	std::vector<std::string> getLightMacros()
     {
 	    const auto conf = Configuration::getInstance();
-	    const auto DirLight = "#define MAX_DIRECTIONAL_LIGHT_NUM " + std::to_string(conf->getMaxSupportDirLightInShader());
-	    const auto PointLight = "#define MAX_DIRECTIONAL_LIGHT_NUM " + std::to_string(conf->getMaxSupportPointLightInShader());
-	    const auto SpotLight = "#define MAX_DIRECTIONAL_LIGHT_NUM " + std::to_string(conf->getMaxSupportSpotLightInShader());
+	    const auto DirLight = "MAX_DIRECTIONAL_LIGHT_NUM=" + std::to_string(conf->getMaxSupportDirLightInShader());
+	    const auto PointLight = "MAX_POINT_LIGHT_NUM=" + std::to_string(conf->getMaxSupportPointLightInShader());
+	    const auto SpotLight = "MAX_SPOT_LIGHT_NUM=" + std::to_string(conf->getMaxSupportSpotLightInShader());
 		return { DirLight, PointLight, SpotLight };
     }
 	std::vector<std::string> getNormalMappingMacros()
     {
 		auto light = getLightMacros();
-		light.emplace_back("#define USE_NORMAL_MAPPING 1");
+		light.emplace_back("USE_NORMAL_MAPPING");
 		return light;
     }
 }
 
-#define NEW_PROGRAM(_v, _f) newProgram(\
+#define NEW_SOURCE(_v, _f) newSource(\
 	std::string(_v##_vary, sizeof(_v##_vary)),\
 	std::string(_v##_vert, sizeof(_v##_vert)),\
 	std::string(_f##_frag, sizeof(_f##_frag)))
-#define NEW_PROGRAM_DEF(_v, _f, _def) newProgram(\
+#define NEW_SOURCE_DEF(_v, _f, _def) newSource(\
 	std::string(_v##_vary, sizeof(_v##_vary)),\
 	std::string(_v##_vert, sizeof(_v##_vert)),\
 	std::string(_f##_frag, sizeof(_f##_frag)),\
@@ -146,143 +146,211 @@ ProgramCache::~ProgramCache()
     {
         CC_SAFE_RELEASE(program.second);
     }
+    ProgramVariantsBX::destroyBuiltins();
     CCLOGINFO("deallocing ProgramCache: %p", this);
     ShaderCache::destroyInstance();
 }
 
-bool ProgramCache::init()
-{
-    addProgram(ProgramType::POSITION_TEXTURE_COLOR);
-    addProgram(ProgramType::ETC1);
-    addProgram(ProgramType::LABEL_DISTANCE_NORMAL);
-    addProgram(ProgramType::LABEL_NORMAL);
-    addProgram(ProgramType::LABLE_OUTLINE);
-    addProgram(ProgramType::LABLE_DISTANCEFIELD_GLOW);
-    addProgram(ProgramType::POSITION_COLOR_LENGTH_TEXTURE);
-    addProgram(ProgramType::POSITION_COLOR_TEXTURE_AS_POINTSIZE);
-    addProgram(ProgramType::POSITION_COLOR);
-    addProgram(ProgramType::POSITION);
-    addProgram(ProgramType::LAYER_RADIA_GRADIENT);
-    addProgram(ProgramType::POSITION_TEXTURE);
-    addProgram(ProgramType::POSITION_TEXTURE_COLOR_ALPHA_TEST);
-    addProgram(ProgramType::POSITION_UCOLOR);
-    addProgram(ProgramType::ETC1_GRAY);
-    addProgram(ProgramType::GRAY_SCALE);
-    addProgram(ProgramType::LINE_COLOR_3D);
-    addProgram(ProgramType::CAMERA_CLEAR);
-    addProgram(ProgramType::SKYBOX_3D);
-    addProgram(ProgramType::SKINPOSITION_TEXTURE_3D);
-    addProgram(ProgramType::SKINPOSITION_NORMAL_TEXTURE_3D);
-    addProgram(ProgramType::POSITION_NORMAL_TEXTURE_3D);
-    addProgram(ProgramType::POSITION_TEXTURE_3D);
-    addProgram(ProgramType::POSITION_3D);
-    addProgram(ProgramType::POSITION_NORMAL_3D);
-    addProgram(ProgramType::POSITION_BUMPEDNORMAL_TEXTURE_3D);
-    addProgram(ProgramType::SKINPOSITION_BUMPEDNORMAL_TEXTURE_3D);
-    addProgram(ProgramType::TERRAIN_3D);
-    addProgram(ProgramType::PARTICLE_TEXTURE_3D);
-    addProgram(ProgramType::PARTICLE_COLOR_3D);
-    return true;
-}
-
-void ProgramCache::addProgram(ProgramType type)
+bool ProgramLoaderBX::getBuiltinSource(ProgramType type, Source& source)
 {
-	ProgramBX* program = nullptr;
     switch (type) {
 	case ProgramType::POSITION_TEXTURE_COLOR:
-		program = NEW_PROGRAM(POSITION_TEXTURE_COLOR, POSITION_TEXTURE_COLOR);
+		source = NEW_SOURCE(POSITION_TEXTURE_COLOR, POSITION_TEXTURE_COLOR);
 		break;
 	case ProgramType::ETC1:
-		program = NEW_PROGRAM(POSITION_TEXTURE_COLOR, ETC1);
+		source = NEW_SOURCE(POSITION_TEXTURE_COLOR, ETC1);
 		break;
 	case ProgramType::LABEL_DISTANCE_NORMAL:
-		program = NEW_PROGRAM(POSITION_TEXTURE_COLOR, LABEL_DISTANCE_NORMAL);
+		source = NEW_SOURCE(POSITION_TEXTURE_COLOR, LABEL_DISTANCE_NORMAL);
 		break;
 	case ProgramType::LABEL_NORMAL:
-		program = NEW_PROGRAM(POSITION_TEXTURE_COLOR, LABEL_NORMAL);
+		source = NEW_SOURCE(POSITION_TEXTURE_COLOR, LABEL_NORMAL);
 		break;
 	case ProgramType::LABLE_OUTLINE:
-		program = NEW_PROGRAM(POSITION_TEXTURE_COLOR, LABLE_OUTLINE);
+		source = NEW_SOURCE(POSITION_TEXTURE_COLOR, LABLE_OUTLINE);
 		break;
 	case ProgramType::LABLE_DISTANCEFIELD_GLOW:
-		program = NEW_PROGRAM(POSITION_TEXTURE_COLOR, LABLE_DISTANCEFIELD_GLOW);
+		source = NEW_SOURCE(POSITION_TEXTURE_COLOR, LABLE_DISTANCEFIELD_GLOW);
 		break;
 	case ProgramType::POSITION_COLOR_LENGTH_TEXTURE:
-		program = NEW_PROGRAM(POSITION_COLOR_LENGTH_TEXTURE, POSITION_COLOR_LENGTH_TEXTURE);
+		source = NEW_SOURCE(POSITION_COLOR_LENGTH_TEXTURE, POSITION_COLOR_LENGTH_TEXTURE);
 		break;
 	case ProgramType::POSITION_COLOR_TEXTURE_AS_POINTSIZE:
-		program = NEW_PROGRAM(POSITION_COLOR_TEXTURE_AS_POINTSIZE, POSITION_COLOR);
+		source = NEW_SOURCE(POSITION_COLOR_TEXTURE_AS_POINTSIZE, POSITION_COLOR);
 		break;
 	case ProgramType::POSITION_COLOR:
-		program = NEW_PROGRAM(POSITION_COLOR, POSITION_COLOR);
+		source = NEW_SOURCE(POSITION_COLOR, POSITION_COLOR);
 		break;
 	case ProgramType::POSITION:
-		program = NEW_PROGRAM(POSITION, POSITION);
+		source = NEW_SOURCE(POSITION, POSITION);
 		break;
 	case ProgramType::LAYER_RADIA_GRADIENT:
-		program = NEW_PROGRAM(POSITION, LAYER_RADIA_GRADIENT);
+		source = NEW_SOURCE(POSITION, LAYER_RADIA_GRADIENT);
 		break;
 	case ProgramType::POSITION_TEXTURE:
-		program = NEW_PROGRAM(POSITION_TEXTURE, POSITION_TEXTURE);
+		source = NEW_SOURCE(POSITION_TEXTURE, POSITION_TEXTURE);
 		break;
 	case ProgramType::POSITION_TEXTURE_COLOR_ALPHA_TEST:
-		program = NEW_PROGRAM(POSITION_TEXTURE_COLOR, POSITION_TEXTURE_COLOR_ALPHA_TEST);
+		source = NEW_SOURCE(POSITION_TEXTURE_COLOR, POSITION_TEXTURE_COLOR_ALPHA_TEST);
 		break;
 	case ProgramType::POSITION_UCOLOR:
-		program = NEW_PROGRAM(POSITION_UCOLOR, POSITION_UCOLOR);
+		source = NEW_SOURCE(POSITION_UCOLOR, POSITION_UCOLOR);
 		break;
 	case ProgramType::ETC1_GRAY:
-		program = NEW_PROGRAM(POSITION_TEXTURE_COLOR, ETC1_GRAY);
+		source = NEW_SOURCE(POSITION_TEXTURE_COLOR, ETC1_GRAY);
 		break;
 	case ProgramType::GRAY_SCALE:
-		program = NEW_PROGRAM(POSITION_TEXTURE_COLOR, GRAY_SCALE);
+		source = NEW_SOURCE(POSITION_TEXTURE_COLOR, GRAY_SCALE);
 		break;
 	case ProgramType::LINE_COLOR_3D:
-		program = NEW_PROGRAM(LINE_COLOR_3D, LINE_COLOR_3D);
+		source = NEW_SOURCE(LINE_COLOR_3D, LINE_COLOR_3D);
 		break;
 	case ProgramType::CAMERA_CLEAR:
-		program = NEW_PROGRAM(CAMERA_CLEAR, CAMERA_CLEAR);
+		source = NEW_SOURCE(CAMERA_CLEAR, CAMERA_CLEAR);
 		break;
 	case ProgramType::SKYBOX_3D:
-		program = NEW_PROGRAM(SKYBOX_3D, SKYBOX_3D);
+		source = NEW_SOURCE(SKYBOX_3D, SKYBOX_3D);
 		break;
 	case ProgramType::SKINPOSITION_TEXTURE_3D:
-		program = NEW_PROGRAM(SKINPOSITION_TEXTURE_3D, SKINPOSITION_TEXTURE_3D);
+		source = NEW_SOURCE(SKINPOSITION_TEXTURE_3D, SKINPOSITION_TEXTURE_3D);
 		break;
 	case ProgramType::SKINPOSITION_NORMAL_TEXTURE_3D:
-		program = NEW_PROGRAM_DEF(SKINPOSITION_NORMAL_TEXTURE_3D, NORMAL_TEXTURE_3D, getLightMacros());
+		source = NEW_SOURCE_DEF(SKINPOSITION_NORMAL_TEXTURE_3D, NORMAL_TEXTURE_3D, getLightMacros());
 		break;
 	case ProgramType::POSITION_NORMAL_TEXTURE_3D:
-		program = NEW_PROGRAM_DEF(POSITION_NORMAL_TEXTURE_3D, NORMAL_TEXTURE_3D, getLightMacros());
+		source = NEW_SOURCE_DEF(POSITION_NORMAL_TEXTURE_3D, NORMAL_TEXTURE_3D, getLightMacros());
 		break;
 	case ProgramType::POSITION_TEXTURE_3D:
-		program = NEW_PROGRAM(POSITION_TEXTURE_3D, POSITION_TEXTURE_3D);
+		source = NEW_SOURCE(POSITION_TEXTURE_3D, POSITION_TEXTURE_3D);
 		break;
 	case ProgramType::POSITION_3D:
-		program = NEW_PROGRAM(POSITION_TEXTURE_3D, POSITION_3D);
+		source = NEW_SOURCE(POSITION_TEXTURE_3D, POSITION_3D);
 		break;
 	case ProgramType::POSITION_NORMAL_3D:
-		program = NEW_PROGRAM_DEF(POSITION_NORMAL_TEXTURE_3D, POSITION_NORMAL_3D, getLightMacros());
+		source = NEW_SOURCE_DEF(POSITION_NORMAL_TEXTURE_3D, POSITION_NORMAL_3D, getLightMacros());
 		break;
 	case ProgramType::POSITION_BUMPEDNORMAL_TEXTURE_3D:
-		program = NEW_PROGRAM_DEF(POSITION_NORMAL_TEXTURE_3D, NORMAL_TEXTURE_3D, getNormalMappingMacros());
+		source = NEW_SOURCE_DEF(POSITION_NORMAL_TEXTURE_3D, NORMAL_TEXTURE_3D, getNormalMappingMacros());
 		break;
 	case ProgramType::SKINPOSITION_BUMPEDNORMAL_TEXTURE_3D:
-		program = NEW_PROGRAM_DEF(SKINPOSITION_NORMAL_TEXTURE_3D, NORMAL_TEXTURE_3D, getNormalMappingMacros());
+		source = NEW_SOURCE_DEF(SKINPOSITION_NORMAL_TEXTURE_3D, NORMAL_TEXTURE_3D, getNormalMappingMacros());
 		break;
 	case ProgramType::TERRAIN_3D:
-		program = NEW_PROGRAM(TERRAIN_3D, TERRAIN_3D);
+		source = NEW_SOURCE(TERRAIN_3D, TERRAIN_3D);
 		break;
 	case ProgramType::PARTICLE_TEXTURE_3D:
-		program = NEW_PROGRAM(PARTICLE_TEXTURE_3D, PARTICLE_TEXTURE_3D);
+		source = NEW_SOURCE(PARTICLE_TEXTURE_3D, PARTICLE_TEXTURE_3D);
 		break;
 	case ProgramType::PARTICLE_COLOR_3D:
-		program = NEW_PROGRAM(PARTICLE_COLOR_3D, PARTICLE_COLOR_3D);
+		source = NEW_SOURCE(PARTICLE_COLOR_3D, PARTICLE_COLOR_3D);
 		break;
     default:
-        CCASSERT(false, "Not built-in program type.");
-        return;
+        return false;
     }
+    return true;
+}
+
+static void compileProgramAsync(ProgramType type)
+{
+	// lit programs are variants, the one used for the type is compiled
+	if (ProgramVariantsBX::hasBuiltinAxes(type))
+	{
+		uint64_t key = 0;
+		if (const auto variants = ProgramVariantsBX::getBuiltin(type, &key))
+			variants->compileAsync(key);
+		return;
+	}
+	ProgramLoaderBX::Source source;
+	if (ProgramLoaderBX::getBuiltinSource(type, source))
+	{
+		ProgramLoaderBX::getInstance()->compileAsync(uint64_t(type),
+			source.vert, source.frag, source.varying, source.defines);
+	}
+}
+
+const std::vector<ProgramType>& ProgramLoaderBX::getBuiltinTypes()
+{
+	static const std::vector<ProgramType> types = {
+		ProgramType::POSITION_TEXTURE_COLOR,
+		ProgramType::ETC1,
+		ProgramType::LABEL_DISTANCE_NORMAL,
+		ProgramType::LABEL_NORMAL,
+		ProgramType::LABLE_OUTLINE,
+		ProgramType::LABLE_DISTANCEFIELD_GLOW,
+		ProgramType::POSITION_COLOR_LENGTH_TEXTURE,
+		ProgramType::POSITION_COLOR_TEXTURE_AS_POINTSIZE,
+		ProgramType::POSITION_COLOR,
+		ProgramType::POSITION,
+		ProgramType::LAYER_RADIA_GRADIENT,
+		ProgramType::POSITION_TEXTURE,
+		ProgramType::POSITION_TEXTURE_COLOR_ALPHA_TEST,
+		ProgramType::POSITION_UCOLOR,
+		ProgramType::ETC1_GRAY,
+		ProgramType::GRAY_SCALE,
+		ProgramType::LINE_COLOR_3D,
+		ProgramType::CAMERA_CLEAR,
+		ProgramType::SKYBOX_3D,
+		ProgramType::SKINPOSITION_TEXTURE_3D,
+		ProgramType::SKINPOSITION_NORMAL_TEXTURE_3D,
+		ProgramType::POSITION_NORMAL_TEXTURE_3D,
+		ProgramType::POSITION_TEXTURE_3D,
+		ProgramType::POSITION_3D,
+		ProgramType::POSITION_NORMAL_3D,
+		ProgramType::POSITION_BUMPEDNORMAL_TEXTURE_3D,
+		ProgramType::SKINPOSITION_BUMPEDNORMAL_TEXTURE_3D,
+		ProgramType::TERRAIN_3D,
+		ProgramType::PARTICLE_TEXTURE_3D,
+		ProgramType::PARTICLE_COLOR_3D,
+	};
+	return types;
+}
+
+bool ProgramCache::init()
+{
+    // shaders compile on workers, programs are created on first lookup
+    const auto loader = ProgramLoaderBX::getInstance();
+    // default pack is loaded here rather than on a worker
+    ShaderPackBX::getInstance();
+    if (loader->isLazyBuiltins())
+    {
+        // others are compiled when they are looked up
+        for (auto type : loader->getWarmList())
+            compileProgramAsync(type);
+        return true;
+    }
+    for (auto type : ProgramLoaderBX::getBuiltinTypes())
+        compileProgramAsync(type);
+    return true;
+}
+
+void ProgramCache::addProgram(ProgramType type)
+{
+	ProgramBX* program = nullptr;
+	if (ProgramVariantsBX::hasBuiltinAxes(type))
+	{
+		// plain and bumped types are variants of one program, so they share its shaders
+		uint64_t key = 0;
+		if (const auto variants = ProgramVariantsBX::getBuiltin(type, &key))
+		{
+			program = variants->getVariant(key);
+			program->retain();
+		}
+	}
+	else
+	{
+		// compiled on workers by init, only waits if it's not done yet
+		program = ProgramLoaderBX::getInstance()->finish(uint64_t(type));
+	}
+	if (!program)
+	{
+		ProgramLoaderBX::Source source;
+		if (!ProgramLoaderBX::getBuiltinSource(type, source))
+		{
+			CCASSERT(false, "Not built-in program type.");
+			return;
+		}
+		program = new ProgramBX(source.vert, source.frag, source.varying, source.defines);
+	}
 	if(!bgfx::isValid(program->getHandle()))
 	{
 		cocos2d::log("failed to create built-in program %d", (int)type);
@@ -298,6 +366,13 @@ backend::Program* ProgramCache::getBuiltinProgram(ProgramType type) const
     {
         return iter->second;
     }
+    ProgramLoaderBX::Source source;
+    if (ProgramLoaderBX::getInstance()->isCompiling(uint64_t(type)) || ProgramLoaderBX::getBuiltinSource(type, source))
+    {
+        const_cast<ProgramCache*>(this)->addProgram(type);
+        const auto it = ProgramCache::_cachedPrograms.find(type);
+        return it != ProgramCache::_cachedPrograms.end() ? it->second : nullptr;
+    }
     return nullptr;
 }
 
@@ -326,7 +401,9 @@ void ProgramCache::removeUnusedProgram()
     for (auto iter = _cachedPrograms.cbegin(); iter != _cachedPrograms.cend();)
     {
         auto program = iter->second;
-        if (program->getReferenceCount() == 1)
+        // programs of lit types are held by their variants too
+        const auto unused = ProgramVariantsBX::hasBuiltinAxes(iter->first) ? 2u : 1u;
+        if (program->getReferenceCount() == unused)
         {
 //            CCLOG("cocos2d: TextureCache: removing unused program");
             program->release();
@@ -337,6 +414,7 @@ void ProgramCache::removeUnusedProgram()
             ++iter;
         }
     }
+    ProgramVariantsBX::removeUnusedBuiltins();
 }
 
 void ProgramCache::removeAllPrograms()
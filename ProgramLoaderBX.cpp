@@ -0,0 +1,131 @@
+#include "ProgramLoaderBX.h"
+#include "ProgramBX.h"
+#include "ShaderModuleBX.h"
+#include "UtilsBX.h"
+#include "base/ccMacros.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+CC_BACKEND_BEGIN
+
+struct ProgramLoaderBX::Job
+{
+	std::string vertexShader;
+	std::string fragmentShader;
+	std::string varying;
+	std::vector<std::string> defines;
+	std::vector<std::string> fragmentDefines;
+	std::string vertexBinary;
+	std::string fragmentBinary;
+	std::chrono::steady_clock::time_point doneTime;
+	std::mutex mutex;
+	std::condition_variable cond;
+	int remaining = 2;
+};
+
+ProgramLoaderBX* ProgramLoaderBX::getInstance()
+{
+	static ProgramLoaderBX ins;
+	return &ins;
+}
+
+void ProgramLoaderBX::compileAsync(uint64_t key, const std::string& vertexShader, const std::string& fragmentShader,
+	const std::string& varying, const std::vector<std::string>& defines)
+{
+	compileAsync(key, { vertexShader, fragmentShader, varying, defines }, defines);
+}
+
+void ProgramLoaderBX::compileAsync(uint64_t key, const Source& source, const std::vector<std::string>& fragmentDefines)
+{
+	if (isCompiling(key))
+		return;
+	if (_jobs.empty())
+	{
+		_startTime = std::chrono::steady_clock::now();
+		_compileMicros = 0;
+		_wallTime = 0;
+		_numFinished = 0;
+	}
+	auto job = std::make_shared<Job>();
+	job->vertexShader = source.vert;
+	job->fragmentShader = source.frag;
+	job->varying = source.varying;
+	job->defines = source.defines;
+	job->fragmentDefines = fragmentDefines;
+	_jobs[key] = job;
+	for (const auto stage : { ShaderStage::VERTEX, ShaderStage::FRAGMENT })
+	{
+		addWorkerTask([=]()
+		{
+			const auto start = std::chrono::steady_clock::now();
+			const auto waited = ShaderModuleBX::getCompileWaitMicros();
+			const auto isVertex = stage == ShaderStage::VERTEX;
+			auto binary = ShaderModuleBX::compileBinary(stage,
+				isVertex ? job->vertexShader : job->fragmentShader, job->varying,
+				isVertex ? job->defines : job->fragmentDefines);
+			const auto end = std::chrono::steady_clock::now();
+			// waiting for compiles on other workers would count the same work twice
+			const auto elapsed = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+			_compileMicros += elapsed - std::min(elapsed, ShaderModuleBX::getCompileWaitMicros() - waited);
+			std::lock_guard<std::mutex> lock(job->mutex);
+			(isVertex ? job->vertexBinary : job->fragmentBinary) = std::move(binary);
+			job->doneTime = std::max(job->doneTime, end);
+			if (--job->remaining == 0)
+				job->cond.notify_all();
+		});
+	}
+}
+
+std::shared_ptr<ProgramLoaderBX::Job> ProgramLoaderBX::wait(uint64_t key)
+{
+	const auto it = _jobs.find(key);
+	if (it == _jobs.end())
+		return nullptr;
+	const auto job = it->second;
+	_jobs.erase(it);
+	{
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->cond.wait(lock, [&]() { return job->remaining == 0; });
+	}
+	_wallTime = std::max(_wallTime, std::chrono::duration<double, std::milli>(job->doneTime - _startTime).count());
+	++_numFinished;
+	if (_jobs.empty())
+	{
+		CCLOG("ProgramLoaderBX: %d programs, %.1f ms of compiling in %.1f ms, %.1f ms saved",
+			int(_numFinished), getCompileTime(), _wallTime, getSavedTime());
+	}
+	return job;
+}
+
+ProgramBX* ProgramLoaderBX::finish(uint64_t key)
+{
+	const auto job = wait(key);
+	if (!job)
+		return nullptr;
+	// failed shaders are compiled again here so that errors are reported as usual
+	const auto& vert = job->vertexBinary.empty() ? job->vertexShader : job->vertexBinary;
+	const auto& frag = job->fragmentBinary.empty() ? job->fragmentShader : job->fragmentBinary;
+	return new ProgramBX(vert, frag, job->varying, job->defines);
+}
+
+bool ProgramLoaderBX::finish(uint64_t key, std::string& vertexShader, std::string& fragmentShader)
+{
+	const auto job = wait(key);
+	if (!job)
+		return false;
+	vertexShader = job->vertexBinary.empty() ? job->vertexShader : job->vertexBinary;
+	fragmentShader = job->fragmentBinary.empty() ? job->fragmentShader : job->fragmentBinary;
+	return true;
+}
+
+bool ProgramLoaderBX::isReady(uint64_t key) const
+{
+	const auto it = _jobs.find(key);
+	if (it == _jobs.end())
+		return false;
+	std::lock_guard<std::mutex> lock(it->second->mutex);
+	return it->second->remaining == 0;
+}
+
+CC_BACKEND_END
@@ -0,0 +1,115 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include "renderer/backend/Types.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+CC_BACKEND_BEGIN
+
+class ProgramBX;
+
+/**
+ * Compiles shaders of programs on worker threads.
+ * Shaders are loaded from packs and caches concurrently, while shaderc is not reentrant
+ * and compiles one shader at a time. bgfx objects are still created on the calling thread in `finish()`.
+ */
+class ProgramLoaderBX
+{
+public:
+	struct Source
+	{
+		std::string vert;
+		std::string frag;
+		std::string varying;
+		std::vector<std::string> defines;
+	};
+
+	static ProgramLoaderBX* getInstance();
+
+	/**
+	 * Get sources of a built-in program.
+	 * @return false if the type is not a built-in program.
+	 */
+	static bool getBuiltinSource(ProgramType type, Source& source);
+	/** All built-in program types. */
+	static const std::vector<ProgramType>& getBuiltinTypes();
+
+	/**
+	 * Start compiling a program, does nothing if the key is already compiling.
+	 * @param key Specifies the key to finish the program with.
+	 * @param vertexShader,fragmentShader Specifies shader sources.
+	 * @param varying Specifies the varying definition.
+	 * @param defines Specifies the macro definitions.
+	 */
+	void compileAsync(uint64_t key, const std::string& vertexShader, const std::string& fragmentShader,
+		const std::string& varying, const std::vector<std::string>& defines = {});
+	/**
+	 * Start compiling a program whose stages have different macro definitions.
+	 * @param source Specifies shader sources, its defines are used by the vertex shader.
+	 * @param fragmentDefines Specifies the macro definitions of the fragment shader.
+	 */
+	void compileAsync(uint64_t key, const Source& source, const std::vector<std::string>& fragmentDefines);
+
+	/**
+	 * Create the program of a key, waits only if its shaders are still compiling.
+	 * @return The program with a reference count of 1, null if the key is not compiling.
+	 */
+	ProgramBX* finish(uint64_t key);
+	/**
+	 * Get compiled shaders of a key instead of a program, waits only if they're still compiling.
+	 * A shader which failed to compile is given as its source, so that errors are reported when it's created.
+	 * @return false if the key is not compiling.
+	 */
+	bool finish(uint64_t key, std::string& vertexShader, std::string& fragmentShader);
+
+	/** Get a key which is not used by built-in programs, whose keys are their types. */
+	uint64_t newKey() { return _nextKey++; }
+
+	/**
+	 * Built-in programs are compiled when first looked up if lazy, otherwise all of them
+	 * start compiling when `ProgramCache` is created. Should be set before that.
+	 */
+	void setLazyBuiltins(bool lazy) { _lazyBuiltins = lazy; }
+	bool isLazyBuiltins() const { return _lazyBuiltins; }
+	/**
+	 * Built-in programs which still start compiling with `ProgramCache` in lazy mode.
+	 */
+	void setWarmList(const std::vector<ProgramType>& types) { _warmList = types; }
+	const std::vector<ProgramType>& getWarmList() const { return _warmList; }
+
+	bool isCompiling(uint64_t key) const { return _jobs.find(key) != _jobs.end(); }
+	/** Compiled shaders are ready and `finish()` will not wait. */
+	bool isReady(uint64_t key) const;
+	size_t getNumPending() const { return _jobs.size(); }
+
+	/** Sum of compile time of all shaders in milliseconds, waiting for the serialized shaderc is excluded. */
+	double getCompileTime() const { return _compileMicros / 1000.0; }
+	/** Time from the first compilation to the last finished one in milliseconds. */
+	double getWallTime() const { return _wallTime; }
+	/**
+	 * Startup time saved by compiling concurrently in milliseconds.
+	 * shaderc compiles one shader at a time, so savings only come from shaders loaded from packs and caches.
+	 */
+	double getSavedTime() const { return getCompileTime() - _wallTime; }
+
+private:
+	ProgramLoaderBX() = default;
+
+	struct Job;
+	std::shared_ptr<Job> wait(uint64_t key);
+
+	std::unordered_map<uint64_t, std::shared_ptr<Job>> _jobs;
+	uint64_t _nextKey = uint64_t(1) << 32;
+	std::chrono::steady_clock::time_point _startTime;
+	std::atomic<uint64_t> _compileMicros{ 0 };
+	double _wallTime = 0;
+	size_t _numFinished = 0;
+	bool _lazyBuiltins = false;
+	std::vector<ProgramType> _warmList;
+};
+
+CC_BACKEND_END
@@ -6,6 +6,7 @@
 #include "base/CCEventDispatcher.h"
 #include "base/CCEventType.h"
 #include "base/CCDirector.h"
+#include "ProgramBX.h"
 //#include "bgfx/bgfx.h"
 
 #include <algorithm>
@@ -14,6 +15,18 @@
 
 CC_BACKEND_BEGIN
 
+namespace
+{
+    // bgfx only supports float uniforms, so ints are stored converted
+    void writeIntAsFloat(char* dst, const void* data, std::size_t size)
+    {
+        const auto src = (const int32_t*)data;
+        const auto out = (float*)dst;
+        for (std::size_t i = 0; i < size / sizeof(int32_t); ++i)
+            out[i] = float(src[i]);
+    }
+}
+
 //static field
 std::vector<ProgramState::AutoBindingResolver*> ProgramState::_customAutoBindingResolvers;
 
@@ -193,14 +206,20 @@ void ProgramState::setVertexUniform(int location, const void* data, std::size_t
 {
     if(location < 0)
         return;
-    memcpy(_vertexUniformBuffer + location, data, size);
+    if (static_cast<ProgramBX*>(_program)->isUniformAsInt(ShaderStage::VERTEX, location))
+        writeIntAsFloat(_vertexUniformBuffer + location, data, size);
+    else
+        memcpy(_vertexUniformBuffer + location, data, size);
 }
 
 void ProgramState::setFragmentUniform(int location, const void* data, std::size_t size)
 {
     if(location < 0)
         return;
-	memcpy(_fragmentUniformBuffer + location, data, size);
+    if (static_cast<ProgramBX*>(_program)->isUniformAsInt(ShaderStage::FRAGMENT, location))
+        writeIntAsFloat(_fragmentUniformBuffer + location, data, size);
+    else
+        memcpy(_fragmentUniformBuffer + location, data, size);
 }
 
 void ProgramState::setTexture(const UniformLocation& uniformLocation, uint32_t slot, TextureBackend* texture)
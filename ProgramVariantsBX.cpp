@@ -0,0 +1,307 @@
+#include "ProgramVariantsBX.h"
+#include "ProgramBX.h"
+#include "ShaderModuleBX.h"
+#include "base/ccMacros.h"
+#include "base/CCConfiguration.h"
+#include <algorithm>
+
+CC_BACKEND_BEGIN
+
+namespace
+{
+	const char* NORMAL_MAPPING = "USE_NORMAL_MAPPING";
+	const char* DIRECTIONAL_LIGHT = "MAX_DIRECTIONAL_LIGHT_NUM";
+	const char* POINT_LIGHT = "MAX_POINT_LIGHT_NUM";
+	const char* SPOT_LIGHT = "MAX_SPOT_LIGHT_NUM";
+
+	std::unordered_map<int, ProgramVariantsBX*> BuiltinVariants;
+
+	// bumped types are the normal mapping variants of plain types
+	ProgramType getBaseType(ProgramType type, bool& normalMapping)
+	{
+		normalMapping = false;
+		switch (type)
+		{
+		case ProgramType::POSITION_BUMPEDNORMAL_TEXTURE_3D:
+			normalMapping = true;
+			return ProgramType::POSITION_NORMAL_TEXTURE_3D;
+		case ProgramType::SKINPOSITION_BUMPEDNORMAL_TEXTURE_3D:
+			normalMapping = true;
+			return ProgramType::SKINPOSITION_NORMAL_TEXTURE_3D;
+		default:
+			return type;
+		}
+	}
+
+	std::vector<ProgramVariantsBX::Axis> getLightAxes()
+	{
+		const auto conf = Configuration::getInstance();
+		const auto maxDir = uint32_t(std::max(conf->getMaxSupportDirLightInShader(), 8));
+		const auto maxPoint = uint32_t(std::max(conf->getMaxSupportPointLightInShader(), 8));
+		const auto maxSpot = uint32_t(std::max(conf->getMaxSupportSpotLightInShader(), 8));
+		return {
+			{ DIRECTIONAL_LIGHT, maxDir, ShaderStage::VERTEX_AND_FRAGMENT },
+			{ POINT_LIGHT, maxPoint, ShaderStage::VERTEX_AND_FRAGMENT },
+			{ SPOT_LIGHT, maxSpot, ShaderStage::VERTEX_AND_FRAGMENT },
+		};
+	}
+}
+
+ProgramVariantsBX* ProgramVariantsBX::create(const ProgramLoaderBX::Source& source, const std::vector<Axis>& axes)
+{
+	auto variants = new (std::nothrow) ProgramVariantsBX();
+	if (!variants)
+		return nullptr;
+	variants->_source = source;
+	variants->_axes = axes;
+	uint32_t shift = 0;
+	for (auto& axis : axes)
+	{
+		uint32_t bits = 1;
+		while (bits < 32 && (axis.maxValue >> bits) != 0)
+			++bits;
+		CCASSERT(shift + bits <= 64, "Too many variant axes.");
+		const auto mask = ((uint64_t(1) << bits) - 1) << shift;
+		if (axis.stage != ShaderStage::FRAGMENT)
+			variants->_vertexMask |= mask;
+		if (axis.stage != ShaderStage::VERTEX)
+			variants->_fragmentMask |= mask;
+		variants->_shifts.push_back(shift);
+		variants->_bits.push_back(bits);
+		shift += bits;
+	}
+	variants->autorelease();
+	return variants;
+}
+
+ProgramVariantsBX* ProgramVariantsBX::getBuiltin(ProgramType type, uint64_t* key)
+{
+	bool normalMapping;
+	const auto base = getBaseType(type, normalMapping);
+	auto it = BuiltinVariants.find(int(base));
+	if (it == BuiltinVariants.end())
+	{
+		ProgramLoaderBX::Source source;
+		if (!ProgramLoaderBX::getBuiltinSource(base, source))
+			return nullptr;
+		// light macros are given by axes instead
+		source.defines.clear();
+		std::vector<Axis> axes;
+		switch (base)
+		{
+		case ProgramType::POSITION_NORMAL_TEXTURE_3D:
+		case ProgramType::SKINPOSITION_NORMAL_TEXTURE_3D:
+			axes = getLightAxes();
+			axes.push_back({ NORMAL_MAPPING, 1, ShaderStage::VERTEX_AND_FRAGMENT });
+			break;
+		case ProgramType::POSITION_NORMAL_3D:
+			axes = getLightAxes();
+			break;
+		default: ;
+		}
+		auto variants = create(source, axes);
+		CC_SAFE_RETAIN(variants);
+		it = BuiltinVariants.emplace(int(base), variants).first;
+	}
+	const auto variants = it->second;
+	if (key && variants)
+	{
+		const auto conf = Configuration::getInstance();
+		uint64_t k = 0;
+		k = variants->setValue(k, DIRECTIONAL_LIGHT, uint32_t(conf->getMaxSupportDirLightInShader()));
+		k = variants->setValue(k, POINT_LIGHT, uint32_t(conf->getMaxSupportPointLightInShader()));
+		k = variants->setValue(k, SPOT_LIGHT, uint32_t(conf->getMaxSupportSpotLightInShader()));
+		k = variants->setValue(k, NORMAL_MAPPING, normalMapping ? 1 : 0);
+		*key = k;
+	}
+	return variants;
+}
+
+bool ProgramVariantsBX::hasBuiltinAxes(ProgramType type)
+{
+	bool normalMapping;
+	switch (getBaseType(type, normalMapping))
+	{
+	case ProgramType::POSITION_NORMAL_TEXTURE_3D:
+	case ProgramType::SKINPOSITION_NORMAL_TEXTURE_3D:
+	case ProgramType::POSITION_NORMAL_3D:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void ProgramVariantsBX::removeUnusedBuiltins()
+{
+	for (auto& it : BuiltinVariants)
+	{
+		if (it.second)
+			it.second->removeUnusedVariants();
+	}
+}
+
+void ProgramVariantsBX::destroyBuiltins()
+{
+	for (auto& it : BuiltinVariants)
+		CC_SAFE_RELEASE(it.second);
+	BuiltinVariants.clear();
+}
+
+ProgramVariantsBX::~ProgramVariantsBX()
+{
+	// jobs are not left in the loader
+	while (!_pending.empty())
+		finishPending(_pending.begin()->first);
+	for (auto& it : _variants)
+		CC_SAFE_RELEASE(it.second);
+	for (auto& it : _vertexModules)
+		CC_SAFE_RELEASE(it.second);
+	for (auto& it : _fragmentModules)
+		CC_SAFE_RELEASE(it.second);
+}
+
+int ProgramVariantsBX::findAxis(const std::string& name) const
+{
+	for (size_t i = 0; i < _axes.size(); ++i)
+	{
+		if (_axes[i].name == name)
+			return int(i);
+	}
+	return -1;
+}
+
+uint64_t ProgramVariantsBX::setValue(uint64_t key, const std::string& axis, uint32_t value) const
+{
+	const auto i = findAxis(axis);
+	if (i < 0)
+		return key;
+	const auto mask = ((uint64_t(1) << _bits[i]) - 1) << _shifts[i];
+	const auto v = uint64_t(std::min(value, _axes[i].maxValue));
+	return (key & ~mask) | (v << _shifts[i]);
+}
+
+uint32_t ProgramVariantsBX::getValue(uint64_t key, const std::string& axis) const
+{
+	const auto i = findAxis(axis);
+	if (i < 0)
+		return 0;
+	return uint32_t((key >> _shifts[i]) & ((uint64_t(1) << _bits[i]) - 1));
+}
+
+std::vector<std::string> ProgramVariantsBX::getDefines(uint64_t key, ShaderStage stage) const
+{
+	auto defines = _source.defines;
+	for (size_t i = 0; i < _axes.size(); ++i)
+	{
+		auto& axis = _axes[i];
+		if (axis.stage != ShaderStage::VERTEX_AND_FRAGMENT && axis.stage != stage)
+			continue;
+		const auto value = uint32_t((key >> _shifts[i]) & ((uint64_t(1) << _bits[i]) - 1));
+		if (axis.maxValue == 1)
+		{
+			if (value)
+				defines.push_back(axis.name);
+		}
+		else
+		{
+			defines.push_back(axis.name + "=" + std::to_string(value));
+		}
+	}
+	return defines;
+}
+
+ProgramBX* ProgramVariantsBX::getVariant(uint64_t key)
+{
+	const auto it = _variants.find(key);
+	if (it != _variants.end())
+		return it->second;
+	finishPending(key);
+	const auto vert = getShaderModule(key, ShaderStage::VERTEX);
+	const auto frag = getShaderModule(key, ShaderStage::FRAGMENT);
+	// failed variants are kept, so they're not compiled again every frame
+	auto program = new ProgramBX(_source.vert, _source.frag, vert, frag);
+	if (!bgfx::isValid(program->getHandle()))
+		CCLOG("ProgramVariantsBX: failed to create variant %llx", (unsigned long long)key);
+	_variants.emplace(key, program);
+	return program;
+}
+
+void ProgramVariantsBX::compileAsync(uint64_t key)
+{
+	if (hasVariant(key) || _pending.find(key) != _pending.end())
+		return;
+	const auto loader = ProgramLoaderBX::getInstance();
+	const auto loaderKey = loader->newKey();
+	auto source = _source;
+	source.defines = getDefines(key, ShaderStage::VERTEX);
+	loader->compileAsync(loaderKey, source, getDefines(key, ShaderStage::FRAGMENT));
+	_pending.emplace(key, loaderKey);
+}
+
+void ProgramVariantsBX::finishPending(uint64_t key)
+{
+	const auto it = _pending.find(key);
+	if (it == _pending.end())
+		return;
+	const auto loaderKey = it->second;
+	_pending.erase(it);
+	std::string vert, frag;
+	if (!ProgramLoaderBX::getInstance()->finish(loaderKey, vert, frag))
+		return;
+	addShaderModule(key, ShaderStage::VERTEX, vert);
+	addShaderModule(key, ShaderStage::FRAGMENT, frag);
+}
+
+void ProgramVariantsBX::addShaderModule(uint64_t key, ShaderStage stage, const std::string& shader)
+{
+	const auto isVertex = stage == ShaderStage::VERTEX;
+	auto& modules = isVertex ? _vertexModules : _fragmentModules;
+	const auto stageKey = key & (isVertex ? _vertexMask : _fragmentMask);
+	if (modules.find(stageKey) != modules.end())
+		return;
+	// compiled binaries are used as is
+	modules.emplace(stageKey, new ShaderModuleBX(stage, shader, _source.varying, getDefines(key, stage)));
+}
+
+ShaderModuleBX* ProgramVariantsBX::getShaderModule(uint64_t key, ShaderStage stage)
+{
+	const auto isVertex = stage == ShaderStage::VERTEX;
+	auto& modules = isVertex ? _vertexModules : _fragmentModules;
+	const auto stageKey = key & (isVertex ? _vertexMask : _fragmentMask);
+	const auto it = modules.find(stageKey);
+	if (it != modules.end())
+		return it->second;
+	const auto module = new ShaderModuleBX(stage, isVertex ? _source.vert : _source.frag,
+		_source.varying, getDefines(key, stage));
+	modules.emplace(stageKey, module);
+	return module;
+}
+
+void ProgramVariantsBX::removeUnusedVariants()
+{
+	for (auto it = _variants.begin(); it != _variants.end();)
+	{
+		if (it->second->getReferenceCount() == 1)
+		{
+			it->second->release();
+			it = _variants.erase(it);
+		}
+		else
+			++it;
+	}
+	for (auto modules : { &_vertexModules, &_fragmentModules })
+	{
+		for (auto it = modules->begin(); it != modules->end();)
+		{
+			if (it->second->getReferenceCount() == 1)
+			{
+				it->second->release();
+				it = modules->erase(it);
+			}
+			else
+				++it;
+		}
+	}
+}
+
+CC_BACKEND_END
@@ -0,0 +1,109 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include "renderer/backend/Types.h"
+#include "base/CCRef.h"
+#include "ProgramLoaderBX.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+CC_BACKEND_BEGIN
+
+class ProgramBX;
+class ShaderModuleBX;
+
+/**
+ * Variants of a program selected by macros, such as light counts or normal mapping.
+ * Axes are declared once and a variant is addressed by a key with a few bits per axis.
+ * Variants are compiled when first requested and kept until removed, variants which
+ * only differ in axes of one stage share the shader of the other stage.
+ */
+class ProgramVariantsBX : public Ref
+{
+public:
+	struct Axis
+	{
+		/** Macro name. */
+		std::string name;
+		/** Largest value, a switch with value 1 is defined as the name only, 0 is not defined. */
+		uint32_t maxValue = 1;
+		/** Stage using the macro. */
+		ShaderStage stage = ShaderStage::VERTEX_AND_FRAGMENT;
+	};
+
+	/**
+	 * @param source Specifies shader sources, defines of it are used by all variants.
+	 * @param axes Specifies axes of variants, at most 64 bits of keys in total.
+	 * @return Variants with no variant compiled yet, autoreleased.
+	 */
+	static ProgramVariantsBX* create(const ProgramLoaderBX::Source& source, const std::vector<Axis>& axes);
+
+	/**
+	 * Get shared variants of a built-in program, lit programs have axes of light counts
+	 * and normal mapping, so bumped types share variants with their plain types.
+	 * @param key Receives the key of the variant used for the type.
+	 * @return Variants, null if the type is not a built-in program.
+	 */
+	static ProgramVariantsBX* getBuiltin(ProgramType type, uint64_t* key = nullptr);
+	/** Built-in type has axes, ProgramCache gets programs of these types from `getBuiltin()`. */
+	static bool hasBuiltinAxes(ProgramType type);
+	/** Remove unused variants of built-in programs. */
+	static void removeUnusedBuiltins();
+	/** Release variants of built-in programs. */
+	static void destroyBuiltins();
+
+	/**
+	 * Set the value of an axis in a key, values are clamped to the largest value of the axis.
+	 * @return The new key, same as the given one if the axis doesn't exist.
+	 */
+	uint64_t setValue(uint64_t key, const std::string& axis, uint32_t value) const;
+	uint32_t getValue(uint64_t key, const std::string& axis) const;
+
+	/**
+	 * Get the program of a variant, it's compiled on first request.
+	 * @return The program owned by the variants, retain it to keep it.
+	 */
+	ProgramBX* getVariant(uint64_t key);
+	/**
+	 * Start compiling shaders of a variant on workers, they're used when the variant is first requested.
+	 */
+	void compileAsync(uint64_t key);
+	bool hasVariant(uint64_t key) const { return _variants.find(key) != _variants.end(); }
+	size_t getNumVariants() const { return _variants.size(); }
+
+	/**
+	 * Get macro definitions of a variant for a stage.
+	 */
+	std::vector<std::string> getDefines(uint64_t key, ShaderStage stage) const;
+
+	const std::vector<Axis>& getAxes() const { return _axes; }
+
+	/**
+	 * Remove variants not retained by others, and shaders not used by remaining variants.
+	 */
+	void removeUnusedVariants();
+
+private:
+	ProgramVariantsBX() = default;
+	~ProgramVariantsBX();
+
+	int findAxis(const std::string& name) const;
+	ShaderModuleBX* getShaderModule(uint64_t key, ShaderStage stage);
+	void addShaderModule(uint64_t key, ShaderStage stage, const std::string& shader);
+	void finishPending(uint64_t key);
+
+	ProgramLoaderBX::Source _source;
+	std::vector<Axis> _axes;
+	std::vector<uint32_t> _shifts;
+	std::vector<uint32_t> _bits;
+	uint64_t _vertexMask = 0;
+	uint64_t _fragmentMask = 0;
+	std::unordered_map<uint64_t, ProgramBX*> _variants;
+	// keys of ProgramLoaderBX compiling variants, keyed by variant
+	std::unordered_map<uint64_t, uint64_t> _pending;
+	// keyed by bits of axes used by the stage
+	std::unordered_map<uint64_t, ShaderModuleBX*> _vertexModules;
+	std::unordered_map<uint64_t, ShaderModuleBX*> _fragmentModules;
+};
+
+CC_BACKEND_END
@@ -0,0 +1,203 @@
+#include "RenderTargetPoolBX.h"
+#include "UtilsBX.h"
+#include "base/CCDirector.h"
+
+using namespace bgfx;
+
+CC_BACKEND_BEGIN
+
+namespace
+{
+	uint32_t currentFrame()
+	{
+		return Director::getInstance()->getTotalFrames();
+	}
+	uint32_t frameBufferKey(TextureHandle color, TextureHandle depthStencil)
+	{
+		return uint32_t(color.idx) << 16 | depthStencil.idx;
+	}
+}
+
+RenderTargetPoolBX* RenderTargetPoolBX::getInstance()
+{
+	static RenderTargetPoolBX ins;
+	return &ins;
+}
+
+RenderTargetPoolBX::~RenderTargetPoolBX()
+{
+	clear();
+}
+
+TextureHandle RenderTargetPoolBX::acquireTexture(uint16_t width, uint16_t height, bool hasMips,
+	TextureFormat::Enum format, uint64_t flags)
+{
+	const auto frame = currentFrame();
+	for (auto& texture : _textures)
+	{
+		// released in this frame, may still be sampled by views submitted earlier
+		if (texture.inUse || texture.lastUse == frame)
+			continue;
+		if (texture.width == width && texture.height == height && texture.hasMips == hasMips
+			&& texture.format == format && texture.flags == flags)
+		{
+			texture.inUse = true;
+			texture.lastUse = frame;
+			++_textureHits;
+			return texture.handle;
+		}
+	}
+	++_textureMisses;
+	Texture texture;
+	texture.handle = createTexture2D(width, height, hasMips, 1, format, flags);
+	if (!isValid(texture.handle))
+		return texture.handle;
+	TextureInfo info;
+	calcTextureSize(info, width, height, 1, false, hasMips, 1, format);
+	texture.width = width;
+	texture.height = height;
+	texture.hasMips = hasMips;
+	texture.format = format;
+	texture.flags = flags;
+	texture.size = info.storageSize;
+	texture.lastUse = frame;
+	texture.inUse = true;
+	_textures.push_back(texture);
+	return texture.handle;
+}
+
+void RenderTargetPoolBX::releaseTexture(TextureHandle handle)
+{
+	for (auto& texture : _textures)
+	{
+		if (texture.handle.idx == handle.idx)
+		{
+			texture.inUse = false;
+			texture.lastUse = currentFrame();
+			return;
+		}
+	}
+	// not from the pool
+	invalidate(handle);
+	destroy(handle);
+}
+
+void RenderTargetPoolBX::invalidate(TextureHandle handle)
+{
+	if (!isValid(handle))
+		return;
+	for (auto it = _frameBuffers.begin(); it != _frameBuffers.end();)
+	{
+		if (it->second.color.idx == handle.idx || it->second.depthStencil.idx == handle.idx)
+		{
+			destroyFrameBuffer(it->second.handle);
+			it = _frameBuffers.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+FrameBufferHandle RenderTargetPoolBX::getFrameBuffer(TextureHandle color, TextureHandle depthStencil)
+{
+	const auto key = frameBufferKey(color, depthStencil);
+	const auto it = _frameBuffers.find(key);
+	if (it != _frameBuffers.end())
+	{
+		it->second.lastUse = currentFrame();
+		++_frameBufferHits;
+		return it->second.handle;
+	}
+	++_frameBufferMisses;
+	TextureHandle textures[2];
+	uint8_t num = 0;
+	if (isValid(color))
+		textures[num++] = color;
+	if (isValid(depthStencil))
+		textures[num++] = depthStencil;
+	FrameBuffer frameBuffer;
+	frameBuffer.handle = createFrameBuffer(num, textures);
+	frameBuffer.color = color;
+	frameBuffer.depthStencil = depthStencil;
+	frameBuffer.lastUse = currentFrame();
+	_frameBuffers[key] = frameBuffer;
+	return frameBuffer.handle;
+}
+
+void RenderTargetPoolBX::process()
+{
+	const auto frame = currentFrame();
+	for (auto it = _frameBuffers.begin(); it != _frameBuffers.end();)
+	{
+		if (frame - it->second.lastUse > _maxIdleFrames)
+		{
+			destroyFrameBuffer(it->second.handle);
+			it = _frameBuffers.erase(it);
+		}
+		else
+			++it;
+	}
+	for (auto it = _textures.begin(); it != _textures.end();)
+	{
+		if (!it->inUse && frame - it->lastUse > _maxIdleFrames)
+		{
+			invalidate(it->handle);
+			destroy(it->handle);
+			it = _textures.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+void RenderTargetPoolBX::clear()
+{
+	for (auto& it : _frameBuffers)
+		destroyFrameBuffer(it.second.handle);
+	_frameBuffers.clear();
+	for (auto it = _textures.begin(); it != _textures.end();)
+	{
+		if (!it->inUse)
+		{
+			destroy(it->handle);
+			it = _textures.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+uint64_t RenderTargetPoolBX::getFreeBytes() const
+{
+	uint64_t bytes = 0;
+	for (auto& texture : _textures)
+	{
+		if (!texture.inUse)
+			bytes += texture.size;
+	}
+	return bytes;
+}
+
+float RenderTargetPoolBX::getTextureHitRate() const
+{
+	const auto total = _textureHits + _textureMisses;
+	return total == 0 ? 0.f : float(_textureHits) / total;
+}
+
+float RenderTargetPoolBX::getFrameBufferHitRate() const
+{
+	const auto total = _frameBufferHits + _frameBufferMisses;
+	return total == 0 ? 0.f : float(_frameBufferHits) / total;
+}
+
+void RenderTargetPoolBX::destroyFrameBuffer(FrameBufferHandle handle)
+{
+	// views queued on the submission thread may still refer to it
+	addThreadTask([=]()
+	{
+		if (bgfx::isValid(handle))
+			bgfx::destroy(handle);
+	});
+}
+
+CC_BACKEND_END
@@ -0,0 +1,111 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include "bgfx/bgfx.h"
+#include <unordered_map>
+#include <vector>
+
+CC_BACKEND_BEGIN
+
+/**
+ * Pools storage of render targets and the frame buffers attaching them.
+ * Released storage is handed out again from the next frame, so textures of
+ * transient targets are aliased instead of created every frame.
+ * Frame buffers are kept while used and destroyed after idle frames.
+ */
+class RenderTargetPoolBX
+{
+public:
+	static RenderTargetPoolBX* getInstance();
+	~RenderTargetPoolBX();
+
+	/**
+	 * Get a render target texture, contents are undefined.
+	 * @param width,height Specifies the size.
+	 * @param hasMips Specifies if the texture has a mip chain.
+	 * @param format Specifies the format.
+	 * @param flags Specifies creation flags, including sampler flags.
+	 */
+	bgfx::TextureHandle acquireTexture(uint16_t width, uint16_t height, bool hasMips,
+		bgfx::TextureFormat::Enum format, uint64_t flags);
+
+	/**
+	 * Return a texture from `acquireTexture()`, it can be acquired again from next frame.
+	 */
+	void releaseTexture(bgfx::TextureHandle handle);
+
+	/**
+	 * Destroy frame buffers attaching a texture which is about to be destroyed.
+	 */
+	void invalidate(bgfx::TextureHandle handle);
+
+	/**
+	 * Get a frame buffer for attachments, created if not cached.
+	 * @param color Specifies the color attachment, can be invalid.
+	 * @param depthStencil Specifies the depth stencil attachment, can be invalid.
+	 */
+	bgfx::FrameBufferHandle getFrameBuffer(bgfx::TextureHandle color, bgfx::TextureHandle depthStencil);
+
+	/**
+	 * Make released textures available and destroy idle ones.
+	 * Should be invoked once per frame.
+	 */
+	void process();
+
+	/**
+	 * Destroy all cached frame buffers and free textures.
+	 */
+	void clear();
+
+	/** Number of frames before an unused texture or frame buffer is destroyed. */
+	void setMaxIdleFrames(uint32_t frames) { _maxIdleFrames = frames; }
+	uint32_t getMaxIdleFrames() const { return _maxIdleFrames; }
+
+	size_t getNumTextures() const { return _textures.size(); }
+	size_t getNumFrameBuffers() const { return _frameBuffers.size(); }
+	/** Bytes of textures which are not acquired. */
+	uint64_t getFreeBytes() const;
+
+	size_t getTextureHits() const { return _textureHits; }
+	size_t getTextureMisses() const { return _textureMisses; }
+	size_t getFrameBufferHits() const { return _frameBufferHits; }
+	size_t getFrameBufferMisses() const { return _frameBufferMisses; }
+	/** Ratio of acquisitions served by the pool. */
+	float getTextureHitRate() const;
+	/** Ratio of frame buffer requests served by the cache. */
+	float getFrameBufferHitRate() const;
+
+private:
+	RenderTargetPoolBX() = default;
+
+	struct Texture
+	{
+		bgfx::TextureHandle handle = BGFX_INVALID_HANDLE;
+		uint16_t width = 0;
+		uint16_t height = 0;
+		bool hasMips = false;
+		bgfx::TextureFormat::Enum format = bgfx::TextureFormat::RGBA8;
+		uint64_t flags = 0;
+		uint32_t size = 0;
+		uint32_t lastUse = 0;
+		bool inUse = false;
+	};
+	struct FrameBuffer
+	{
+		bgfx::FrameBufferHandle handle = BGFX_INVALID_HANDLE;
+		bgfx::TextureHandle color = BGFX_INVALID_HANDLE;
+		bgfx::TextureHandle depthStencil = BGFX_INVALID_HANDLE;
+		uint32_t lastUse = 0;
+	};
+
+	void destroyFrameBuffer(bgfx::FrameBufferHandle handle);
+
+	std::vector<Texture> _textures;
+	std::unordered_map<uint32_t, FrameBuffer> _frameBuffers;
+	size_t _textureHits = 0;
+	size_t _textureMisses = 0;
+	size_t _frameBufferHits = 0;
+	size_t _frameBufferMisses = 0;
+	uint32_t _maxIdleFrames = 120;
+};
+
+CC_BACKEND_END
@@ -0,0 +1,171 @@
+#include "ShaderCacheBX.h"
+#include "platform/CCFileUtils.h"
+#include "base/ccMacros.h"
+#include <cstdio>
+
+CC_BACKEND_BEGIN
+
+namespace
+{
+	// bumped when the layout of cached files changes
+	constexpr uint32_t CACHE_VERSION = 1;
+	constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+	constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+	void hashBytes(uint64_t& hash, const void* data, size_t size)
+	{
+		const auto bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= FNV_PRIME;
+		}
+	}
+	// length is hashed too, so that fields can't run into each other
+	void hashString(uint64_t& hash, const std::string& str)
+	{
+		const uint64_t size = str.size();
+		hashBytes(hash, &size, sizeof(size));
+		hashBytes(hash, str.data(), str.size());
+	}
+	template<typename T>
+	void hashValue(uint64_t& hash, const T& value)
+	{
+		hashBytes(hash, &value, sizeof(value));
+	}
+	std::string getDefaultDirectory()
+	{
+		return FileUtils::getInstance()->getWritablePath() + "shader_cache/";
+	}
+}
+
+ShaderCacheBX* ShaderCacheBX::getInstance()
+{
+	static ShaderCacheBX ins;
+	return &ins;
+}
+
+uint64_t ShaderCacheBX::computeKey(const std::string& source, const std::string& varying,
+	const std::vector<std::string>& defines, bgfx::RendererType::Enum renderer,
+	const std::string& platform, const std::string& profile, char shaderType, bool debugInformation)
+{
+	uint64_t hash = FNV_OFFSET;
+	hashValue(hash, CACHE_VERSION);
+	// shader compiler is built from the same bgfx version
+	hashValue(hash, uint32_t(BGFX_API_VERSION));
+	hashValue(hash, uint32_t(renderer));
+	hashValue(hash, shaderType);
+	hashValue(hash, debugInformation);
+	hashString(hash, platform);
+	hashString(hash, profile);
+	hashString(hash, varying);
+	hashValue(hash, uint64_t(defines.size()));
+	for (auto& define : defines)
+		hashString(hash, define);
+	hashString(hash, source);
+	return hash;
+}
+
+bool ShaderCacheBX::load(uint64_t key, std::string& binary)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!_enabled)
+		return false;
+	const auto path = getPath(key);
+	auto f = std::fopen(path.c_str(), "rb");
+	if (!f)
+	{
+		++_misses;
+		return false;
+	}
+	std::fseek(f, 0, SEEK_END);
+	const auto size = std::ftell(f);
+	std::fseek(f, 0, SEEK_SET);
+	binary.resize(size > 0 ? size_t(size) : 0);
+	const auto read = binary.empty() ? 0 : std::fread(&binary[0], 1, binary.size(), f);
+	std::fclose(f);
+	if (binary.empty() || read != binary.size())
+	{
+		++_misses;
+		binary.clear();
+		return false;
+	}
+	++_hits;
+	return true;
+}
+
+void ShaderCacheBX::store(uint64_t key, const std::string& binary)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!_enabled || binary.empty() || !checkDirectory())
+		return;
+	const auto path = getPath(key);
+	const auto tmpPath = path + ".tmp";
+	auto f = std::fopen(tmpPath.c_str(), "wb");
+	if (!f)
+		return;
+	const auto written = std::fwrite(binary.data(), 1, binary.size(), f);
+	std::fclose(f);
+	// another process may have stored the same binary meanwhile
+	if (written != binary.size() || std::rename(tmpPath.c_str(), path.c_str()) != 0)
+	{
+		std::remove(tmpPath.c_str());
+		return;
+	}
+	++_stores;
+}
+
+void ShaderCacheBX::clear()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const auto directory = _directory.empty() ? getDefaultDirectory() : _directory;
+	auto fileUtils = FileUtils::getInstance();
+	if (fileUtils->isDirectoryExist(directory))
+		fileUtils->removeDirectory(directory);
+	_directoryChecked = false;
+}
+
+void ShaderCacheBX::setDirectory(const std::string& directory)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_directory = directory;
+	if (!_directory.empty() && _directory.back() != '/')
+		_directory.push_back('/');
+	_directoryChecked = false;
+}
+
+std::string ShaderCacheBX::getDirectory()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _directory;
+}
+
+float ShaderCacheBX::getHitRate() const
+{
+	const auto total = _hits + _misses;
+	return total == 0 ? 0.f : float(_hits) / total;
+}
+
+std::string ShaderCacheBX::getPath(uint64_t key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	if (_directory.empty())
+		return getDefaultDirectory() + name;
+	return _directory + name;
+}
+
+bool ShaderCacheBX::checkDirectory()
+{
+	if (_directoryChecked)
+		return true;
+	if (_directory.empty())
+		_directory = getDefaultDirectory();
+	auto fileUtils = FileUtils::getInstance();
+	_directoryChecked = fileUtils->isDirectoryExist(_directory) || fileUtils->createDirectory(_directory);
+	if (!_directoryChecked)
+		CCLOG("ShaderCacheBX: can't create directory %s", _directory.c_str());
+	return _directoryChecked;
+}
+
+CC_BACKEND_END
@@ -0,0 +1,79 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include "bgfx/bgfx.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+CC_BACKEND_BEGIN
+
+/**
+ * Keeps compiled shader binaries on disk, so shaders are compiled once per machine
+ * instead of at every launch. Binaries are addressed by a hash of everything that
+ * affects the compiler output, stale entries are never hit and can be cleared.
+ * Can be used from worker threads.
+ */
+class ShaderCacheBX
+{
+public:
+	static ShaderCacheBX* getInstance();
+
+	/**
+	 * Compute the key of a compilation, shader compiler version is included.
+	 * @param source Specifies the source passed to the compiler.
+	 * @param varying Specifies the varying definition.
+	 * @param defines Specifies the macro definitions.
+	 * @param renderer Specifies the renderer type.
+	 * @param platform,profile Specifies compiler target.
+	 * @param shaderType Specifies 'v' for vertex shaders, 'f' for fragment shaders.
+	 * @param debugInformation Specifies if debug information is generated.
+	 */
+	static uint64_t computeKey(const std::string& source, const std::string& varying,
+		const std::vector<std::string>& defines, bgfx::RendererType::Enum renderer,
+		const std::string& platform, const std::string& profile, char shaderType, bool debugInformation);
+
+	/**
+	 * Load a binary.
+	 * @return true if found.
+	 */
+	bool load(uint64_t key, std::string& binary);
+
+	/**
+	 * Store a binary, it's written to a temporary file first so that other
+	 * processes never read a partial binary.
+	 */
+	void store(uint64_t key, const std::string& binary);
+
+	/**
+	 * Remove all cached binaries.
+	 */
+	void clear();
+
+	/** Directory of binaries, default is "shader_cache/" in the writable path. */
+	void setDirectory(const std::string& directory);
+	std::string getDirectory();
+	void setEnabled(bool enabled) { _enabled = enabled; }
+	bool isEnabled() const { return _enabled; }
+
+	size_t getHits() const { return _hits; }
+	size_t getMisses() const { return _misses; }
+	size_t getStores() const { return _stores; }
+	/** Ratio of loads served by the cache. */
+	float getHitRate() const;
+
+private:
+	ShaderCacheBX() = default;
+
+	std::string getPath(uint64_t key) const;
+	bool checkDirectory();
+
+	std::mutex _mutex;
+	std::string _directory;
+	bool _directoryChecked = false;
+	bool _enabled = true;
+	size_t _hits = 0;
+	size_t _misses = 0;
+	size_t _stores = 0;
+};
+
+CC_BACKEND_END
@@ -1,8 +1,12 @@
 #include "ShaderModuleBX.h"
+#include "ShaderCacheBX.h"
+#include "ShaderPackBX.h"
 #include "ccMacros.h"
 #include "bgfx_shader.h"
 #include "renderer/ccShaders.h"
 #include <algorithm>
+#include <chrono>
+#include <cstring>
 
 #define BGFX_SHADER_BIN_VERSION 6
 #define BGFX_CHUNK_MAGIC_CSH BX_MAKEFOURCC('C', 'S', 'H', BGFX_SHADER_BIN_VERSION)
@@ -75,56 +79,154 @@ namespace
 #include "shaders/TERRAIN_3D.vert"
 }
 
-static const std::unordered_map<std::string, std::string> BgfxFragShaderReplace = {
-	{ cocos2d::positionColor_frag, POSITION_COLOR_frag },
-	{ cocos2d::positionTexture_frag, POSITION_TEXTURE_frag },
-	{ cocos2d::positionTextureColor_frag, POSITION_TEXTURE_COLOR_frag },
-	{ cocos2d::positionTextureColorAlphaTest_frag, POSITION_TEXTURE_COLOR_ALPHA_TEST_frag },
-	{ cocos2d::label_normal_frag, LABEL_NORMAL_frag },
-	{ cocos2d::label_distanceNormal_frag, LABEL_DISTANCE_NORMAL_frag },
-	{ cocos2d::labelOutline_frag, LABLE_OUTLINE_frag },
-	{ cocos2d::labelDistanceFieldGlow_frag, LABLE_DISTANCEFIELD_GLOW_frag },
-	{ cocos2d::lineColor3D_frag, LINE_COLOR_3D_frag },
-	{ cocos2d::positionColorLengthTexture_frag, POSITION_COLOR_LENGTH_TEXTURE_frag },
-	{ cocos2d::layer_radialGradient_frag, LAYER_RADIA_GRADIENT_frag },
-	{ cocos2d::grayScale_frag, GRAY_SCALE_frag },
-	// missing positionTextureUColor_frag
-	{ cocos2d::positionUColor_frag, POSITION_UCOLOR_frag },
-	{ cocos2d::etc1_frag, ETC1_frag },
-	{ cocos2d::etc1Gray_frag, ETC1_GRAY_frag },
-	{ cocos2d::cameraClear_frag, CAMERA_CLEAR_frag },
-	{ cocos2d::CC3D_color_frag, POSITION_3D_frag },
-	{ cocos2d::CC3D_colorNormal_frag, POSITION_NORMAL_3D_frag },
-	{ cocos2d::CC3D_colorNormalTexture_frag, NORMAL_TEXTURE_3D_frag },
-	{ cocos2d::CC3D_colorTexture_frag, POSITION_TEXTURE_3D_frag },
-	{ cocos2d::CC3D_particleTexture_frag, PARTICLE_TEXTURE_3D_frag },
-	{ cocos2d::CC3D_particleColor_frag, PARTICLE_COLOR_3D_frag },
-	{ cocos2d::CC3D_skybox_frag, SKYBOX_3D_frag },
-	{ cocos2d::CC3D_terrain_frag, TERRAIN_3D_frag },
-};
-static const std::unordered_map<std::string, std::pair<std::string, std::string>> BgfxVertShaderReplace = {
-	{ cocos2d::positionColor_vert, { POSITION_COLOR_vert, POSITION_COLOR_vary } },
-	{ cocos2d::positionTexture_vert, { POSITION_TEXTURE_vert, POSITION_TEXTURE_vary } },
-	{ cocos2d::positionTextureColor_vert, { POSITION_TEXTURE_COLOR_vert, POSITION_TEXTURE_COLOR_vary } },
-	{ cocos2d::lineColor3D_vert, { LINE_COLOR_3D_vert, LINE_COLOR_3D_vary } },
-	{ cocos2d::positionColorLengthTexture_vert, { POSITION_COLOR_LENGTH_TEXTURE_vert, POSITION_COLOR_LENGTH_TEXTURE_vary } },
-	{ cocos2d::positionColorTextureAsPointsize_vert, { POSITION_COLOR_TEXTURE_AS_POINTSIZE_vert, POSITION_COLOR_TEXTURE_AS_POINTSIZE_vary } },
-	{ cocos2d::position_vert, { POSITION_vert, POSITION_vary } },
-	// missing positionNoMVP_vert
-	// missing positionTextureUColor_vert
-	{ cocos2d::positionUColor_vert, { POSITION_UCOLOR_vert, POSITION_UCOLOR_vary } },
-	{ cocos2d::cameraClear_vert, { CAMERA_CLEAR_vert, CAMERA_CLEAR_vary } },
-	{ cocos2d::CC3D_particle_vert, { PARTICLE_TEXTURE_3D_vert, PARTICLE_TEXTURE_3D_vary } },
-	{ cocos2d::CC3D_positionNormalTexture_vert, { POSITION_NORMAL_TEXTURE_3D_vert, POSITION_NORMAL_TEXTURE_3D_vary } },
-	{ cocos2d::CC3D_skinPositionNormalTexture_vert, { SKINPOSITION_NORMAL_TEXTURE_3D_vert, SKINPOSITION_NORMAL_TEXTURE_3D_vary } },
-	{ cocos2d::CC3D_positionTexture_vert, { POSITION_TEXTURE_3D_vert, POSITION_TEXTURE_3D_vary } },
-	{ cocos2d::CC3D_skinPositionTexture_vert, { SKINPOSITION_TEXTURE_3D_vert, SKINPOSITION_TEXTURE_3D_vary } },
-	{ cocos2d::CC3D_skybox_vert, { SKYBOX_3D_vert, SKYBOX_3D_vary } },
-	{ cocos2d::CC3D_terrain_vert, { TERRAIN_3D_vert, TERRAIN_3D_vary } },
-};
+namespace
+{
+	// cocos sources are only known at runtime, so they're hashed on first lookup
+	struct ShaderReplace
+	{
+		const char* const* cocosSource;
+		const char* source;
+		size_t sourceSize;
+		const char* varying;
+	};
+	struct ReplaceIndex
+	{
+		size_t size;
+		uint64_t hash;
+		const ShaderReplace* replace;
+	};
+
+#define FRAG_REPLACE(_cc, _bx) { &cocos2d::_cc, _bx##_frag, sizeof(_bx##_frag) - 1, nullptr }
+#define VERT_REPLACE(_cc, _bx) { &cocos2d::_cc, _bx##_vert, sizeof(_bx##_vert) - 1, _bx##_vary }
+
+	const ShaderReplace BgfxFragShaderReplace[] = {
+		FRAG_REPLACE(positionColor_frag, POSITION_COLOR),
+		FRAG_REPLACE(positionTexture_frag, POSITION_TEXTURE),
+		FRAG_REPLACE(positionTextureColor_frag, POSITION_TEXTURE_COLOR),
+		FRAG_REPLACE(positionTextureColorAlphaTest_frag, POSITION_TEXTURE_COLOR_ALPHA_TEST),
+		FRAG_REPLACE(label_normal_frag, LABEL_NORMAL),
+		FRAG_REPLACE(label_distanceNormal_frag, LABEL_DISTANCE_NORMAL),
+		FRAG_REPLACE(labelOutline_frag, LABLE_OUTLINE),
+		FRAG_REPLACE(labelDistanceFieldGlow_frag, LABLE_DISTANCEFIELD_GLOW),
+		FRAG_REPLACE(lineColor3D_frag, LINE_COLOR_3D),
+		FRAG_REPLACE(positionColorLengthTexture_frag, POSITION_COLOR_LENGTH_TEXTURE),
+		FRAG_REPLACE(layer_radialGradient_frag, LAYER_RADIA_GRADIENT),
+		FRAG_REPLACE(grayScale_frag, GRAY_SCALE),
+		// missing positionTextureUColor_frag
+		FRAG_REPLACE(positionUColor_frag, POSITION_UCOLOR),
+		FRAG_REPLACE(etc1_frag, ETC1),
+		FRAG_REPLACE(etc1Gray_frag, ETC1_GRAY),
+		FRAG_REPLACE(cameraClear_frag, CAMERA_CLEAR),
+		FRAG_REPLACE(CC3D_color_frag, POSITION_3D),
+		FRAG_REPLACE(CC3D_colorNormal_frag, POSITION_NORMAL_3D),
+		FRAG_REPLACE(CC3D_colorNormalTexture_frag, NORMAL_TEXTURE_3D),
+		FRAG_REPLACE(CC3D_colorTexture_frag, POSITION_TEXTURE_3D),
+		FRAG_REPLACE(CC3D_particleTexture_frag, PARTICLE_TEXTURE_3D),
+		FRAG_REPLACE(CC3D_particleColor_frag, PARTICLE_COLOR_3D),
+		FRAG_REPLACE(CC3D_skybox_frag, SKYBOX_3D),
+		FRAG_REPLACE(CC3D_terrain_frag, TERRAIN_3D),
+	};
+	const ShaderReplace BgfxVertShaderReplace[] = {
+		VERT_REPLACE(positionColor_vert, POSITION_COLOR),
+		VERT_REPLACE(positionTexture_vert, POSITION_TEXTURE),
+		VERT_REPLACE(positionTextureColor_vert, POSITION_TEXTURE_COLOR),
+		VERT_REPLACE(lineColor3D_vert, LINE_COLOR_3D),
+		VERT_REPLACE(positionColorLengthTexture_vert, POSITION_COLOR_LENGTH_TEXTURE),
+		VERT_REPLACE(positionColorTextureAsPointsize_vert, POSITION_COLOR_TEXTURE_AS_POINTSIZE),
+		VERT_REPLACE(position_vert, POSITION),
+		// missing positionNoMVP_vert
+		// missing positionTextureUColor_vert
+		VERT_REPLACE(positionUColor_vert, POSITION_UCOLOR),
+		VERT_REPLACE(cameraClear_vert, CAMERA_CLEAR),
+		VERT_REPLACE(CC3D_particle_vert, PARTICLE_TEXTURE_3D),
+		VERT_REPLACE(CC3D_positionNormalTexture_vert, POSITION_NORMAL_TEXTURE_3D),
+		VERT_REPLACE(CC3D_skinPositionNormalTexture_vert, SKINPOSITION_NORMAL_TEXTURE_3D),
+		VERT_REPLACE(CC3D_positionTexture_vert, POSITION_TEXTURE_3D),
+		VERT_REPLACE(CC3D_skinPositionTexture_vert, SKINPOSITION_TEXTURE_3D),
+		VERT_REPLACE(CC3D_skybox_vert, SKYBOX_3D),
+		VERT_REPLACE(CC3D_terrain_vert, TERRAIN_3D),
+	};
+
+#undef FRAG_REPLACE
+#undef VERT_REPLACE
+
+	uint64_t hashSource(const char* data, size_t size)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= uint8_t(data[i]);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	template <size_t N>
+	std::vector<ReplaceIndex> buildReplaceIndex(const ShaderReplace (&replaces)[N])
+	{
+		std::vector<ReplaceIndex> index;
+		for (auto& replace : replaces)
+		{
+			const auto source = *replace.cocosSource;
+			if (!source)
+				continue;
+			const auto size = std::strlen(source);
+			index.push_back({ size, hashSource(source, size), &replace });
+		}
+		std::sort(index.begin(), index.end(), [](const ReplaceIndex& a, const ReplaceIndex& b)
+		{
+			return a.size < b.size || (a.size == b.size && a.hash < b.hash);
+		});
+		return index;
+	}
+
+	// sources are only hashed if a built-in source has the same length
+	const ShaderReplace* findReplace(const std::vector<ReplaceIndex>& index, const std::string& source)
+	{
+		auto it = std::lower_bound(index.begin(), index.end(), source.size(),
+			[](const ReplaceIndex& a, size_t size) { return a.size < size; });
+		if (it == index.end() || it->size != source.size())
+			return nullptr;
+		const auto hash = hashSource(source.data(), source.size());
+		for (; it != index.end() && it->size == source.size(); ++it)
+		{
+			// hashes only narrow down the candidates
+			if (it->hash == hash && std::memcmp(source.data(), *it->replace->cocosSource, source.size()) == 0)
+				return it->replace;
+		}
+		return nullptr;
+	}
+
+	// built on first use, after cocos sources are initialized
+	const std::vector<ReplaceIndex>& getFragReplaceIndex()
+	{
+		static const auto index = buildReplaceIndex(BgfxFragShaderReplace);
+		return index;
+	}
+	const std::vector<ReplaceIndex>& getVertReplaceIndex()
+	{
+		static const auto index = buildReplaceIndex(BgfxVertShaderReplace);
+		return index;
+	}
+}
+
+static bool isShaderBinary(const std::string& source)
+{
+	if (source.size() <= 4)
+		return false;
+	uint32_t header = 0;
+	std::memcpy(&header, source.c_str(), sizeof(uint32_t));
+	return header == BGFX_CHUNK_MAGIC_CSH
+		|| header == BGFX_CHUNK_MAGIC_FSH
+		|| header == BGFX_CHUNK_MAGIC_VSH;
+}
 
 static const std::string SHADER_MACROS = { BGFX_SHADER_MACROS, sizeof(BGFX_SHADER_MACROS) };
 std::string cocos2d::backend::ShaderModuleBX::DEFAULT_VARYING = POSITION_TEXTURE_COLOR_vary;
+std::unordered_map<std::string, std::string> cocos2d::backend::ShaderModuleBX::Includes;
+std::mutex cocos2d::backend::ShaderModuleBX::IncludeMutex;
+std::mutex cocos2d::backend::ShaderModuleBX::CompileMutex;
+static thread_local uint64_t CompileWaitMicros = 0;
 static const std::string DefaultVert = POSITION_TEXTURE_COLOR_vert;
 static const std::string DefaultFrag = POSITION_TEXTURE_COLOR_frag;
 static const std::string DefaultVertHeader = "$input a_position, a_color0, a_texcoord0\n$output v_color0, v_texcoord0";
@@ -202,50 +304,104 @@ void ShaderModuleBX::setDefaultVarying(const std::string& varying)
 	DEFAULT_VARYING = varying;
 }
 
-void ShaderModuleBX::compileShader(ShaderStage stage, const std::string& source)
+void ShaderModuleBX::addInclude(const std::string& name, const std::string& source)
 {
-	compileShader(stage, source, DEFAULT_VARYING);
+	std::lock_guard<std::mutex> lock(IncludeMutex);
+	Includes[name] = source;
 }
 
-void ShaderModuleBX::compileShader(ShaderStage stage, const std::string& source, const std::string& varying,
-	const std::vector<std::string>& defines, const std::vector<std::string>& includes)
+void ShaderModuleBX::removeInclude(const std::string& name)
 {
-	if (source.size() > 4)
+	std::lock_guard<std::mutex> lock(IncludeMutex);
+	Includes.erase(name);
+}
+
+void ShaderModuleBX::expandIncludes(std::string& source, int depth)
+{
+	if (depth > 8)
+	{
+		CCLOG("ShaderModuleBX: includes are nested too deep");
+		return;
+	}
+	size_t pos = 0;
+	while ((pos = source.find("#include", pos)) != std::string::npos)
 	{
-		uint32_t header = 0;
-		std::memcpy(&header, source.c_str(), sizeof(uint32_t));
-		if (header == BGFX_CHUNK_MAGIC_CSH
-			|| header == BGFX_CHUNK_MAGIC_FSH
-			|| header == BGFX_CHUNK_MAGIC_VSH)
+		const auto lineStart = source.rfind('\n', pos);
+		const auto begin = lineStart == std::string::npos ? 0 : lineStart + 1;
+		auto end = source.find('\n', pos);
+		if (end == std::string::npos)
+			end = source.size();
+		const auto nameBegin = source.find_first_of("\"<", pos);
+		const auto nameEnd = nameBegin < end ? source.find_first_of("\">", nameBegin + 1) : std::string::npos;
+		// only directives at the start of a line
+		if (source.find_first_not_of(" \t", begin) != pos || nameEnd >= end)
 		{
-			_handle = createShader(copy(source.data(), source.size()));
-			if (!bgfx::isValid(_handle))
+			pos = end;
+			continue;
+		}
+		const auto name = source.substr(nameBegin + 1, nameEnd - nameBegin - 1);
+		std::string included;
+		{
+			std::lock_guard<std::mutex> lock(IncludeMutex);
+			const auto it = Includes.find(name);
+			if (it == Includes.end())
 			{
-				CCLOG("cocos2d: ERROR: Failed to compile shader");
-				//CCASSERT(false, "Shader compile failed!");
+				pos = end;
+				continue;
 			}
-			return;
+			included = it->second;
 		}
+		expandIncludes(included, depth + 1);
+		source.replace(begin, end - begin, included);
+		pos = begin + included.size();
+	}
+}
+
+void ShaderModuleBX::compileShader(ShaderStage stage, const std::string& source)
+{
+	compileShader(stage, source, DEFAULT_VARYING);
+}
+
+void ShaderModuleBX::compileShader(ShaderStage stage, const std::string& source, const std::string& varying,
+	const std::vector<std::string>& defines, const std::vector<std::string>& includes)
+{
+	const auto binary = compileBinary(stage, source, varying, defines, includes);
+	if (!binary.empty())
+		_handle = createShader(copy(binary.data(), uint32_t(binary.size())));
+	if (!bgfx::isValid(_handle))
+	{
+		cocos2d::log("cocos2d: ERROR: Failed to create shader");
+		// binaries given by user are not asserted
+		CCASSERT(isShaderBinary(source), "Shader compile failed!");
 	}
+}
 
-	Options op;
-	op.disasm = false;
-	op.raw = false;
+std::string ShaderModuleBX::compileBinary(ShaderStage stage, const std::string& source, const std::string& varying,
+	const std::vector<std::string>& defines, const std::vector<std::string>& includes)
+{
+	if (isShaderBinary(source))
+		return source;
+	const auto renderer = getRendererType();
+	bool debugInformation = false;
 #if defined(COCOS2D_DEBUG) && COCOS2D_DEBUG > 0
-	op.debugInformation = true;
-#endif
-#if CC_TARGET_PLATFORM == CC_PLATFORM_WIN32
-	op.platform = "windows";
-#elif CC_TARGET_PLATFORM == CC_PLATFORM_ANDROID
-	op.platform = "android";
-#elif CC_TARGET_PLATFORM == CC_PLATFORM_IOS
-	op.platform = "ios";
-#elif CC_TARGET_PLATFORM == CC_PLATFORM_MAC
-	op.platform = "osx";
-#elif CC_TARGET_PLATFORM == CC_PLATFORM_LINUX
-	op.platform = "linux";
+	// shaderc writes the generated HLSL next to the output file when debug information is on
+	debugInformation = renderer != RendererType::Direct3D9
+		&& renderer != RendererType::Direct3D11
+		&& renderer != RendererType::Direct3D12;
 #endif
+	return compile(stage, source, varying, defines, includes,
+		renderer, getProfile(renderer, stage), debugInformation, nullptr);
+}
 
+std::string ShaderModuleBX::compileBinary(ShaderStage stage, const std::string& source, const std::string& varying,
+	const std::vector<std::string>& defines, RendererType::Enum renderer, const std::string& profile,
+	uint64_t* packKey)
+{
+	return compile(stage, source, varying, defines, {}, renderer, profile, false, packKey);
+}
+
+std::string ShaderModuleBX::getProfile(RendererType::Enum renderer, ShaderStage stage)
+{
 	static std::unordered_map<std::string, std::string> GL_VER = {
 		{ "OpenGL 2.1", "120" },
 		{ "OpenGL 3.1", "140" },
@@ -259,57 +415,70 @@ void ShaderModuleBX::compileShader(ShaderStage stage, const std::string& source,
 		{ "OpenGL 4.5", "450" },
 		{ "OpenGL 4.6", "460" },
 	};
-	switch (getRendererType())
+	switch (renderer)
 	{
 	case RendererType::Noop: break;
 	case RendererType::Direct3D9:
 		if(stage == ShaderStage::VERTEX)
-			op.profile = "vs_3_0";
+			return "vs_3_0";
 		else
-			op.profile = "ps_3_0";
-		break;
+			return "ps_3_0";
 	case RendererType::Direct3D11:
 	case RendererType::Direct3D12:
 		if (stage == ShaderStage::VERTEX)
-			op.profile = "vs_5_0";
+			return "vs_5_0";
 		else
-			op.profile = "ps_5_0";
-		break;
+			return "ps_5_0";
 	case RendererType::Gnm: break;
-	case RendererType::Metal: op.profile = "metal"; break;
+	case RendererType::Metal: return "metal";
 	case RendererType::Nvn: break;
 	case RendererType::OpenGLES: break;
 	case RendererType::OpenGL:
 		{
 			const auto it = GL_VER.find(getRendererName(RendererType::OpenGL));
 			if (it != GL_VER.end())
-				op.profile = it->second;
+				return it->second;
 		}
 		break;
-	case RendererType::Vulkan: op.profile = "spirv"; break;
+	case RendererType::Vulkan: return "spirv";
 	case RendererType::Count: break;
 	default:;
 	}
-	op.defines = defines;
-	//TODO: includes
+	return {};
+}
+
+std::string ShaderModuleBX::compile(ShaderStage stage, const std::string& source, const std::string& varying,
+	const std::vector<std::string>& defines, const std::vector<std::string>& includes,
+	RendererType::Enum renderer, const std::string& profile, bool debugInformation, uint64_t* packKey)
+{
+	std::string platform;
+#if CC_TARGET_PLATFORM == CC_PLATFORM_WIN32
+	platform = "windows";
+#elif CC_TARGET_PLATFORM == CC_PLATFORM_ANDROID
+	platform = "android";
+#elif CC_TARGET_PLATFORM == CC_PLATFORM_IOS
+	platform = "ios";
+#elif CC_TARGET_PLATFORM == CC_PLATFORM_MAC
+	platform = "osx";
+#elif CC_TARGET_PLATFORM == CC_PLATFORM_LINUX
+	platform = "linux";
+#endif
 
 	auto src = source;
 	auto vary = varying.empty() ? DEFAULT_VARYING.c_str() : varying.c_str();
 	// replace internal shaders
 	if (stage == ShaderStage::VERTEX)
 	{
-		const auto it = BgfxVertShaderReplace.find(src);
-		if (it != BgfxVertShaderReplace.end())
+		if (const auto replace = findReplace(getVertReplaceIndex(), src))
 		{
-			src = it->second.first;
-			vary = it->second.second.c_str();
+			src.assign(replace->source, replace->sourceSize);
+			vary = replace->varying;
 		}
 	}
 	else
 	{
-		const auto it = BgfxFragShaderReplace.find(src);
-		if (it != BgfxFragShaderReplace.end())
-			src = it->second;
+		if (const auto replace = findReplace(getFragReplaceIndex(), src))
+			src.assign(replace->source, replace->sourceSize);
 	}
 	if (src.empty())
 	{
@@ -325,17 +494,17 @@ void ShaderModuleBX::compileShader(ShaderStage stage, const std::string& source,
 	{
 		src = src.substr(3);
 	}
-	FILE* f = nullptr;
+	expandIncludes(src, 0);
 	do
 	{
-		op.shaderType = '\0';
+		char shaderType = '\0';
 		switch (stage)
 		{
-		case ShaderStage::VERTEX: op.shaderType = 'v'; break;
-		case ShaderStage::FRAGMENT: op.shaderType = 'f'; break;
+		case ShaderStage::VERTEX: shaderType = 'v'; break;
+		case ShaderStage::FRAGMENT: shaderType = 'f'; break;
 		default: ;
 		}
-		if (op.shaderType == '\0')
+		if (shaderType == '\0')
 			break;
 
 		// insert after header
@@ -363,6 +532,35 @@ void ShaderModuleBX::compileShader(ShaderStage stage, const std::string& source,
 				src = DefaultFragHeader + "\n" + SHADER_MACROS + line1 + line2 + rest;
 		}
 		src.push_back('\n');
+		// output is given by renderer and profile, except GLES without a profile where shaderc
+		// picks the shading language from the platform, so packs can be built on another platform
+		const auto keyPlatform = renderer == RendererType::OpenGLES && profile.empty() ? platform : std::string();
+		// packs are built without debug information, so that every build can use them
+		const auto key = ShaderCacheBX::computeKey(src, vary, defines, renderer, keyPlatform, profile,
+			shaderType, false);
+		// files from include directories are not part of the key
+		const bool cacheable = includes.empty();
+		std::string binary;
+		if (packKey)
+			*packKey = key;
+		else if (cacheable && ShaderPackBX::getInstance()->find(key, binary))
+			return binary;
+		auto cache = ShaderCacheBX::getInstance();
+		const auto cacheKey = debugInformation ? ShaderCacheBX::computeKey(src, vary, defines, renderer,
+			keyPlatform, profile, shaderType, true) : key;
+		if (cacheable && cache->load(cacheKey, binary) && isShaderBinary(binary))
+			return binary;
+#if CC_BGFX_USE_SHADERC
+		Options op;
+		op.disasm = false;
+		op.raw = false;
+		op.debugInformation = debugInformation;
+		op.platform = platform;
+		op.profile = profile;
+		op.shaderType = shaderType;
+		op.defines = defines;
+		// includes not added with addInclude are resolved from these directories
+		op.includeDirs = includes;
 		StringWriter writer;
 		const size_t padding = 16384;
 		// data is deleted in bgfx::compileShader
@@ -370,28 +568,37 @@ void ShaderModuleBX::compileShader(ShaderStage stage, const std::string& source,
 		std::memcpy(data, src.c_str(), src.size());
 		std::memset(&data[src.size()], 0, padding);
 
-		auto tmpname = std::tmpnam(nullptr);
-		f = nullptr;
-		if (tmpname)
-			f = std::fopen(tmpname, "wb+");
-		if (!tmpname || !f)
-			break;
-		std::fwrite(data, src.size() + padding, 1, f);
-		op.inputFilePath = tmpname;
-
-		if (!bgfx::compileShader(
-			vary, "", data, (uint32_t)src.size(), op, &writer))
+		// source is compiled from memory, the name only appears in messages
+		op.inputFilePath = stage == ShaderStage::VERTEX ? "vs_memory.sc" : "fs_memory.sc";
+		op.keepIntermediate = false;
+		bool compiled;
+		{
+			// the preprocessor keeps global state for all renderers,
+			// and glsl-optimizer releases its global tables after each GL/GLES compile
+			const auto waitStart = std::chrono::steady_clock::now();
+			std::lock_guard<std::mutex> lock(CompileMutex);
+			CompileWaitMicros += uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - waitStart).count());
+			compiled = bgfx::compileShader(vary, "", data, (uint32_t)src.size(), op, &writer);
+		}
+		if (!compiled)
 			break;
-		_handle = createShader(copy(writer.buf.c_str(), writer.buf.size()));
-		if (!bgfx::isValid(_handle))
+		if (writer.buf.empty())
 			break;
-		std::fclose(f);
-		return;
+		if (cacheable)
+			cache->store(cacheKey, writer.buf);
+		return writer.buf;
+#else
+		cocos2d::log("cocos2d: ERROR: shader is not precompiled and shaderc is not available");
+#endif
 	} while (false);
-	if (f)
-		std::fclose(f);
 	cocos2d::log("cocos2d: ERROR: Failed to compile shader");
-	CCASSERT(false, "Shader compile failed!");
+	return {};
+}
+
+uint64_t ShaderModuleBX::getCompileWaitMicros()
+{
+	return CompileWaitMicros;
 }
 
 char* ShaderModuleBX::getErrorLog(ShaderHandle shader) const
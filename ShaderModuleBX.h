@@ -2,8 +2,16 @@
 #include "renderer/backend/ShaderModule.h"
 #include "bgfx/bgfx.h"
 #include "bx/file.h"
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
+// shaders not found in packs or the cache are compiled at runtime by shaderc,
+// set to 0 to build without shaderc when all shaders are precompiled
+#ifndef CC_BGFX_USE_SHADERC
+#define CC_BGFX_USE_SHADERC 1
+#endif
+
 namespace bgfx
 {
 	struct Options
@@ -67,6 +75,38 @@ public:
 	bgfx::ShaderHandle getHandle() const { return _handle; }
 	static void setDefaultVarying();
 	static void setDefaultVarying(const std::string& varying);
+	/**
+	 * Register source for `#include "name"` in shaders, it's inserted in memory before compiling.
+	 */
+	static void addInclude(const std::string& name, const std::string& source);
+	static void removeInclude(const std::string& name);
+	/**
+	 * Compile a shader into bgfx binary without creating it, can be invoked from worker threads.
+	 * Source which is already a binary is returned as is.
+	 * @return The binary, empty if failed.
+	 */
+	static std::string compileBinary(ShaderStage stage, const std::string& source,
+		const std::string& varying,
+		const std::vector<std::string>& defines = {},
+		const std::vector<std::string>& includes = {});
+	/**
+	 * Compile a shader for a renderer without debug information, used to build shader packs.
+	 * @param profile Specifies the shader profile, see `getProfile()`.
+	 * @param packKey Receives the key of the binary in shader packs.
+	 * @return The binary, empty if failed.
+	 */
+	static std::string compileBinary(ShaderStage stage, const std::string& source,
+		const std::string& varying, const std::vector<std::string>& defines,
+		bgfx::RendererType::Enum renderer, const std::string& profile, uint64_t* packKey);
+	/**
+	 * Get the shader profile used for a renderer, OpenGL uses the version bgfx is built with.
+	 */
+	static std::string getProfile(bgfx::RendererType::Enum renderer, ShaderStage stage);
+	/**
+	 * Time the calling thread has spent waiting for compiles of other threads in microseconds.
+	 * shaderc compiles are serialized since it's not reentrant.
+	 */
+	static uint64_t getCompileWaitMicros();
 
 private:
 	void compileShader(ShaderStage stage, const std::string& source);
@@ -74,11 +114,19 @@ private:
 		const std::string& varying,
 		const std::vector<std::string>& defines = {},
 		const std::vector<std::string>& includes = {});
+	static void expandIncludes(std::string& source, int depth);
+	static std::string compile(ShaderStage stage, const std::string& source, const std::string& varying,
+		const std::vector<std::string>& defines, const std::vector<std::string>& includes,
+		bgfx::RendererType::Enum renderer, const std::string& profile, bool debugInformation, uint64_t* packKey);
 	char* getErrorLog(bgfx::ShaderHandle shader) const;
 	void deleteShader();
 
 	bgfx::ShaderHandle _handle;
 	static std::string DEFAULT_VARYING;
+	static std::unordered_map<std::string, std::string> Includes;
+	static std::mutex IncludeMutex;
+	// shaderc is not reentrant
+	static std::mutex CompileMutex;
 	friend class ProgramBX;
 };
 
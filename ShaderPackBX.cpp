@@ -0,0 +1,178 @@
+#include "ShaderPackBX.h"
+#include "ShaderModuleBX.h"
+#include "platform/CCFileUtils.h"
+#include "base/ccMacros.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+CC_BACKEND_BEGIN
+
+namespace
+{
+	constexpr uint32_t PACK_MAGIC = 'C' | 'S' << 8 | 'P' << 16 | 'K' << 24;
+	constexpr uint32_t PACK_VERSION = 1;
+	const char* DEFAULT_FILENAME = "shaders.bxpack";
+
+	// file layout: header, entries sorted by key, then binaries
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t count;
+		uint32_t reserved;
+	};
+	struct Entry
+	{
+		uint64_t key;
+		uint32_t offset;
+		uint32_t size;
+	};
+}
+
+ShaderPackBX* ShaderPackBX::getInstance()
+{
+	static ShaderPackBX ins;
+	return &ins;
+}
+
+ShaderPackBX::ShaderPackBX()
+{
+	if (FileUtils::getInstance()->isFileExist(DEFAULT_FILENAME))
+		load(DEFAULT_FILENAME);
+}
+
+bool ShaderPackBX::load(const std::string& filename)
+{
+	const auto data = FileUtils::getInstance()->getDataFromFile(filename);
+	const auto bytes = data.getBytes();
+	const auto size = size_t(data.getSize());
+	Header header;
+	if (size < sizeof(Header))
+	{
+		CCLOG("ShaderPackBX: can't load %s", filename.c_str());
+		return false;
+	}
+	std::memcpy(&header, bytes, sizeof(Header));
+	if (header.magic != PACK_MAGIC || header.version != PACK_VERSION
+		|| size < sizeof(Header) + size_t(header.count) * sizeof(Entry))
+	{
+		CCLOG("ShaderPackBX: %s is not a valid pack", filename.c_str());
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (uint32_t i = 0; i < header.count; ++i)
+	{
+		Entry entry;
+		std::memcpy(&entry, bytes + sizeof(Header) + i * sizeof(Entry), sizeof(Entry));
+		if (size_t(entry.offset) + entry.size > size)
+		{
+			CCLOG("ShaderPackBX: %s is truncated", filename.c_str());
+			return false;
+		}
+		_binaries[entry.key].assign((const char*)bytes + entry.offset, entry.size);
+	}
+	return true;
+}
+
+void ShaderPackBX::clear()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_binaries.clear();
+}
+
+bool ShaderPackBX::find(uint64_t key, std::string& binary)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	const auto it = _binaries.find(key);
+	if (it == _binaries.end())
+		return false;
+	binary = it->second;
+	++_hits;
+	return true;
+}
+
+bool ShaderPackBX::build(const std::string& path, const std::vector<Target>& targets,
+	const std::vector<ProgramLoaderBX::Source>& programs)
+{
+	auto sources = programs;
+	for (auto type : ProgramLoaderBX::getBuiltinTypes())
+	{
+		ProgramLoaderBX::Source source;
+		if (ProgramLoaderBX::getBuiltinSource(type, source))
+			sources.push_back(source);
+	}
+	std::vector<std::pair<uint64_t, std::string>> binaries;
+	size_t failed = 0;
+	for (auto& target : targets)
+	{
+		for (auto& source : sources)
+		{
+			for (const auto stage : { ShaderStage::VERTEX, ShaderStage::FRAGMENT })
+			{
+				const auto isVertex = stage == ShaderStage::VERTEX;
+				const auto profile = target.profile.empty() ?
+					ShaderModuleBX::getProfile(target.renderer, stage) : target.profile;
+				uint64_t key = 0;
+				auto binary = ShaderModuleBX::compileBinary(stage, isVertex ? source.vert : source.frag,
+					source.varying, source.defines, target.renderer, profile, &key);
+				if (binary.empty())
+					++failed;
+				else
+					binaries.emplace_back(key, std::move(binary));
+			}
+		}
+	}
+	// shaders shared by programs are stored once
+	std::sort(binaries.begin(), binaries.end(),
+		[](const std::pair<uint64_t, std::string>& a, const std::pair<uint64_t, std::string>& b)
+	{
+		return a.first < b.first;
+	});
+	binaries.erase(std::unique(binaries.begin(), binaries.end(),
+		[](const std::pair<uint64_t, std::string>& a, const std::pair<uint64_t, std::string>& b)
+	{
+		return a.first == b.first;
+	}), binaries.end());
+
+	Header header = { PACK_MAGIC, PACK_VERSION, uint32_t(binaries.size()), 0 };
+	std::vector<Entry> entries;
+	uint32_t offset = uint32_t(sizeof(Header) + binaries.size() * sizeof(Entry));
+	for (auto& binary : binaries)
+	{
+		entries.push_back({ binary.first, offset, uint32_t(binary.second.size()) });
+		offset += uint32_t(binary.second.size());
+	}
+	auto f = std::fopen(path.c_str(), "wb");
+	if (!f)
+	{
+		CCLOG("ShaderPackBX: can't write %s", path.c_str());
+		return false;
+	}
+	bool ok = std::fwrite(&header, sizeof(Header), 1, f) == 1;
+	if (!entries.empty())
+		ok = ok && std::fwrite(entries.data(), sizeof(Entry), entries.size(), f) == entries.size();
+	for (auto& binary : binaries)
+		ok = ok && std::fwrite(binary.second.data(), 1, binary.second.size(), f) == binary.second.size();
+	std::fclose(f);
+	CCLOG("ShaderPackBX: %d binaries written to %s, %d shaders failed",
+		int(binaries.size()), path.c_str(), int(failed));
+	return ok;
+}
+
+std::vector<ShaderPackBX::Target> ShaderPackBX::getAllTargets()
+{
+	std::vector<Target> targets = {
+		{ bgfx::RendererType::Direct3D9, "" },
+		{ bgfx::RendererType::Direct3D11, "" },
+		{ bgfx::RendererType::Direct3D12, "" },
+		{ bgfx::RendererType::Metal, "" },
+		{ bgfx::RendererType::Vulkan, "" },
+		{ bgfx::RendererType::OpenGLES, "" },
+	};
+	for (auto profile : { "120", "140", "150", "330", "400", "410", "420", "430", "440", "450", "460" })
+		targets.push_back({ bgfx::RendererType::OpenGL, profile });
+	return targets;
+}
+
+CC_BACKEND_END
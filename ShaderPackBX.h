@@ -0,0 +1,79 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include "ProgramLoaderBX.h"
+#include "bgfx/bgfx.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+CC_BACKEND_BEGIN
+
+/**
+ * Precompiled shader binaries packed in one file, used before the disk cache and shaderc.
+ * A pack is built with `build()` for every renderer the title ships with,
+ * binaries are addressed by the same keys as `ShaderCacheBX` without debug information.
+ * Keys don't include the platform, since renderer and profile determine the output,
+ * so a pack built on Windows also serves other platforms. The exception is OpenGLES,
+ * whose shading language is picked from the platform, its binaries only serve the platform built on.
+ * Shaders which test `BX_PLATFORM_*` macros get the values of the platform built on.
+ * A pack named "shaders.bxpack" is loaded on first use if it exists.
+ */
+class ShaderPackBX
+{
+public:
+	struct Target
+	{
+		bgfx::RendererType::Enum renderer;
+		/** Shader profile, empty for the default of the renderer. */
+		std::string profile;
+	};
+
+	static ShaderPackBX* getInstance();
+
+	/**
+	 * Load a pack, binaries are added to those loaded before.
+	 * @param filename Specifies the file, searched with `FileUtils`.
+	 * @return true if loaded.
+	 */
+	bool load(const std::string& filename);
+
+	/**
+	 * Remove all loaded binaries.
+	 */
+	void clear();
+
+	/**
+	 * Find a binary, can be invoked from worker threads.
+	 * @return true if found.
+	 */
+	bool find(uint64_t key, std::string& binary);
+
+	size_t getNumBinaries() const { return _binaries.size(); }
+	size_t getHits() const { return _hits; }
+
+	/**
+	 * Compile shaders of all built-in programs and given programs for targets, and write them into a pack.
+	 * Targets the current platform can't compile for are skipped with an error.
+	 * @param path Specifies the output file.
+	 * @param targets Specifies renderers and profiles, see `getAllTargets()`.
+	 * @param programs Specifies other programs to include.
+	 * @return true if the pack is written.
+	 */
+	static bool build(const std::string& path, const std::vector<Target>& targets,
+		const std::vector<ProgramLoaderBX::Source>& programs = {});
+
+	/**
+	 * Get all renderers and profiles supported by the shader compiler.
+	 */
+	static std::vector<Target> getAllTargets();
+
+private:
+	ShaderPackBX();
+
+	std::mutex _mutex;
+	std::unordered_map<uint64_t, std::string> _binaries;
+	size_t _hits = 0;
+};
+
+CC_BACKEND_END
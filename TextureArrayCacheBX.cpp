@@ -0,0 +1,281 @@
+#include "TextureArrayCacheBX.h"
+#include "TextureBX.h"
+#include "ProgramBX.h"
+#include "UtilsBX.h"
+#include "renderer/CCTexture2D.h"
+#include "renderer/backend/ProgramState.h"
+#include "base/CCDirector.h"
+#include "base/CCEventDispatcher.h"
+#include "base/CCEventType.h"
+#include <algorithm>
+
+CC_BACKEND_BEGIN
+
+namespace
+{
+#include "shaders/POSITION_TEXTURE_COLOR_ARRAY.frag"
+#include "shaders/POSITION_TEXTURE_COLOR_ARRAY.vary"
+#include "shaders/POSITION_TEXTURE_COLOR_ARRAY.vert"
+
+	uint32_t currentFrame()
+	{
+		return Director::getInstance()->getTotalFrames();
+	}
+}
+
+TextureArrayCacheBX* TextureArrayCacheBX::getInstance()
+{
+	static TextureArrayCacheBX ins;
+	return &ins;
+}
+
+TextureArrayCacheBX::~TextureArrayCacheBX()
+{
+	for (auto& it : _spriteStates)
+		CC_SAFE_RELEASE(it.second.programState);
+	_spriteStates.clear();
+	for (auto& array : _arrays)
+		CC_SAFE_RELEASE(array.texture);
+	_arrays.clear();
+	_regions.clear();
+	CC_SAFE_RELEASE_NULL(_program);
+}
+
+bool TextureArrayCacheBX::isEnabled() const
+{
+	return _enabled && (bgfx::getCaps()->supported & BGFX_CAPS_TEXTURE_2D_ARRAY) != 0;
+}
+
+bool TextureArrayCacheBX::isCacheable(Texture2DBX* texture) const
+{
+	if (!texture || !isEnabled())
+		return false;
+	uint32_t width, height;
+	texture->getSize(width, height);
+	if (width == 0 || height == 0 || width > _maxTextureSize || height > _maxTextureSize)
+		return false;
+	if (texture->getTextureFormat() != PixelFormat::RGBA8888 || texture->hasMipmaps()
+		|| texture->getTextureUsage() == TextureUsage::RENDER_TARGET)
+		return false;
+	// arrays are created with the default sampler
+	const bool isPow2 = (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+	return texture->getSamplerFlag() == UtilsBX::toBXSampler(SamplerDescriptor(), false, isPow2);
+}
+
+bool TextureArrayCacheBX::add(Texture2DBX* texture, const uint8_t* data)
+{
+	if (!data || !isCacheable(texture))
+		return false;
+	uint32_t width, height;
+	texture->getSize(width, height);
+	if (_regions.find(texture) != _regions.end())
+	{
+		update(texture, 0, 0, width, height, data);
+		return true;
+	}
+	Array* target = nullptr;
+	for (auto& array : _arrays)
+	{
+		if (array.width == width && array.height == height && array.numUsed < array.used.size())
+		{
+			target = &array;
+			break;
+		}
+	}
+	if (!target && _arrays.size() < _maxArrays)
+		target = createArray(width, height);
+	if (!target)
+		return false;
+
+	const auto free = std::find(target->used.begin(), target->used.end(), false);
+	Region region;
+	region.array = target->texture;
+	region.arrayId = target->id;
+	region.layer = uint16_t(free - target->used.begin());
+	region.lastUse = currentFrame();
+	*free = true;
+	target->numUsed++;
+	_regions[texture] = region;
+	update(texture, 0, 0, width, height, data);
+	return true;
+}
+
+void TextureArrayCacheBX::update(Texture2DBX* texture, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+	const uint8_t* data)
+{
+	const auto it = _regions.find(texture);
+	if (it == _regions.end() || !data)
+		return;
+	auto array = getArray(it->second.arrayId);
+	if (!array)
+		return;
+	array->backend->updateLayer(it->second.layer, x, y, width, height, 0, data, size_t(width) * height * 4);
+}
+
+void TextureArrayCacheBX::remove(Texture2DBX* texture)
+{
+	const auto it = _regions.find(texture);
+	if (it != _regions.end())
+		removeEntry(it);
+}
+
+void TextureArrayCacheBX::invalidate(Texture2DArrayBX* array)
+{
+	const auto target = std::find_if(_arrays.begin(), _arrays.end(), [=](const Array& a)
+	{
+		return a.backend == array;
+	});
+	if (target == _arrays.end())
+		return;
+	const auto id = target->id;
+	for (auto it = _regions.begin(); it != _regions.end();)
+	{
+		auto next = std::next(it);
+		if (it->second.arrayId == id)
+			removeEntry(it);
+		it = next;
+	}
+}
+
+const TextureArrayCacheBX::Region* TextureArrayCacheBX::find(TextureBackend* texture)
+{
+	if (_regions.empty())
+		return nullptr;
+	const auto it = _regions.find(texture);
+	if (it == _regions.end())
+		return nullptr;
+	it->second.lastUse = currentFrame();
+	return &it->second;
+}
+
+void TextureArrayCacheBX::process()
+{
+	const auto frame = currentFrame();
+	if (_idleFrames > 0 && frame % 30 == 0)
+	{
+		for (auto it = _regions.begin(); it != _regions.end();)
+		{
+			auto next = std::next(it);
+			if (frame - it->second.lastUse > _idleFrames)
+				removeEntry(it);
+			it = next;
+		}
+	}
+	for (auto it = _arrays.begin(); it != _arrays.end();)
+	{
+		if (it->numUsed == 0)
+		{
+			CC_SAFE_RELEASE(it->texture);
+			it = _arrays.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+Program* TextureArrayCacheBX::getProgram()
+{
+	if (!_program)
+	{
+		auto program = new (std::nothrow) ProgramBX(
+			std::string(POSITION_TEXTURE_COLOR_ARRAY_vert, sizeof(POSITION_TEXTURE_COLOR_ARRAY_vert)),
+			std::string(POSITION_TEXTURE_COLOR_ARRAY_frag, sizeof(POSITION_TEXTURE_COLOR_ARRAY_frag)),
+			std::string(POSITION_TEXTURE_COLOR_ARRAY_vary, sizeof(POSITION_TEXTURE_COLOR_ARRAY_vary)));
+		// custom programs are never batched
+		if (program)
+			program->setBuiltinType(ProgramType::POSITION_TEXTURE_COLOR);
+		_program = program;
+	}
+	return _program;
+}
+
+ProgramState* TextureArrayCacheBX::getProgramState(const Sprite* sprite, uint32_t arrayId)
+{
+	auto array = getArray(arrayId);
+	if (!array)
+		return nullptr;
+	auto& state = _spriteStates[sprite];
+	if (!state.programState)
+	{
+		const auto program = getProgram();
+		state.programState = program ? new (std::nothrow) ProgramState(program) : nullptr;
+		if (!state.programState)
+		{
+			_spriteStates.erase(sprite);
+			return nullptr;
+		}
+	}
+	if (state.arrayId != arrayId)
+	{
+		auto programState = state.programState;
+		programState->setTexture(programState->getUniformLocation(Uniform::TEXTURE), 0, array->backend);
+		state.arrayId = arrayId;
+	}
+	return state.programState;
+}
+
+void TextureArrayCacheBX::removeSprite(const Sprite* sprite)
+{
+	const auto it = _spriteStates.find(sprite);
+	if (it == _spriteStates.end())
+		return;
+	CC_SAFE_RELEASE(it->second.programState);
+	_spriteStates.erase(it);
+}
+
+TextureArrayCacheBX::Array* TextureArrayCacheBX::createArray(uint32_t width, uint32_t height)
+{
+	const auto numLayers = uint16_t(std::min<uint32_t>(_numLayers, bgfx::getCaps()->limits.maxTextureLayers));
+	if (numLayers < 2)
+		return nullptr;
+	TextureDescriptor descriptor;
+	descriptor.width = width;
+	descriptor.height = height;
+	descriptor.textureFormat = PixelFormat::RGBA8888;
+	auto backend = new (std::nothrow) Texture2DArrayBX(descriptor, numLayers);
+	if (!backend)
+		return nullptr;
+	auto texture = new (std::nothrow) Texture2D();
+	if (!texture || !texture->initWithBackendTexture(backend))
+	{
+		CC_SAFE_RELEASE(texture);
+		backend->release();
+		return nullptr;
+	}
+	// retained by the texture
+	backend->release();
+	Array array;
+	array.texture = texture;
+	array.backend = backend;
+	array.id = _nextArrayId++;
+	array.width = width;
+	array.height = height;
+	array.used.resize(numLayers, false);
+	_arrays.push_back(array);
+	return &_arrays.back();
+}
+
+TextureArrayCacheBX::Array* TextureArrayCacheBX::getArray(uint32_t id)
+{
+	for (auto& array : _arrays)
+	{
+		if (array.id == id)
+			return &array;
+	}
+	return nullptr;
+}
+
+void TextureArrayCacheBX::removeEntry(std::unordered_map<TextureBackend*, Region>::iterator it)
+{
+	if (auto array = getArray(it->second.arrayId))
+	{
+		if (array->used[it->second.layer])
+		{
+			array->used[it->second.layer] = false;
+			array->numUsed--;
+		}
+	}
+	_regions.erase(it);
+}
+
+CC_BACKEND_END
@@ -0,0 +1,150 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include <unordered_map>
+#include <vector>
+
+NS_CC_BEGIN
+class Texture2D;
+class Sprite;
+NS_CC_END
+
+CC_BACKEND_BEGIN
+
+class Program;
+class ProgramState;
+class TextureBackend;
+class Texture2DBX;
+class Texture2DArrayBX;
+
+/**
+ * Copies textures with the same size and format into layers of shared texture arrays,
+ * so that sprites using different textures can be batched with the array program.
+ * The array program reads the layer from texture coordinates, see `encodeLayer()`.
+ */
+class TextureArrayCacheBX
+{
+public:
+	struct Region
+	{
+		/** Array texture. */
+		Texture2D* array = nullptr;
+		/** Unique id of the array, never reused. */
+		uint32_t arrayId = 0;
+		uint16_t layer = 0;
+		uint32_t lastUse = 0;
+	};
+
+	static TextureArrayCacheBX* getInstance();
+	~TextureArrayCacheBX();
+
+	/**
+	 * Copy a texture into a layer from its level 0 data.
+	 * @param texture Specifies the source texture.
+	 * @param data Specifies level 0 pixels.
+	 * @return true if the texture is added.
+	 */
+	bool add(Texture2DBX* texture, const uint8_t* data);
+
+	/**
+	 * Forward an update of level 0 to the layer.
+	 */
+	void update(Texture2DBX* texture, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+		const uint8_t* data);
+
+	/**
+	 * Remove a texture, sprites using it will fall back to the texture.
+	 */
+	void remove(Texture2DBX* texture);
+
+	/**
+	 * Remove all layers of an array whose storage is recreated, since layers are not kept on CPU.
+	 * Sprites using them will fall back to their textures.
+	 */
+	void invalidate(Texture2DArrayBX* array);
+
+	/**
+	 * Find the layer of a texture and mark it as used in current frame.
+	 * @return The region, null if the texture is not in an array.
+	 */
+	const Region* find(TextureBackend* texture);
+
+	/**
+	 * Evict idle layers and release empty arrays.
+	 * Should be invoked once per frame.
+	 */
+	void process();
+
+	/**
+	 * Get the sprite program which samples arrays, it has the same uniforms as `POSITION_TEXTURE_COLOR`.
+	 * It's typed as `POSITION_TEXTURE_COLOR`, so that sprites using it are batched.
+	 */
+	Program* getProgram();
+
+	/**
+	 * Get the program state of the array program for a sprite, with the array bound.
+	 * Each sprite has its own state, since uniforms like the MVP matrix are read when rendered.
+	 * @param sprite Specifies the sprite.
+	 * @param arrayId Specifies the array which the sprite is drawn from.
+	 * @return The program state, null if the array doesn't exist.
+	 */
+	ProgramState* getProgramState(const Sprite* sprite, uint32_t arrayId);
+	/** Should be invoked when a sprite is destroyed. */
+	void removeSprite(const Sprite* sprite);
+
+	/**
+	 * Offset texture coordinate u to select a layer in the array program.
+	 */
+	static float encodeLayer(float u, uint16_t layer) { return u + 2.f * layer; }
+
+	/** Textures added later are not copied when disabled, it's disabled if arrays are not supported. */
+	void setEnabled(bool enabled) { _enabled = enabled; }
+	bool isEnabled() const;
+	/** Max width and height of textures. */
+	void setMaxTextureSize(uint32_t size) { _maxTextureSize = size; }
+	uint32_t getMaxTextureSize() const { return _maxTextureSize; }
+	/** Number of frames before an unused layer is evicted, 0 means never. */
+	void setIdleFrames(uint32_t frames) { _idleFrames = frames; }
+	uint32_t getIdleFrames() const { return _idleFrames; }
+
+	size_t getNumArrays() const { return _arrays.size(); }
+	size_t getNumRegions() const { return _regions.size(); }
+
+private:
+	TextureArrayCacheBX() = default;
+
+	struct Array
+	{
+		Texture2D* texture = nullptr;
+		Texture2DArrayBX* backend = nullptr;
+		uint32_t id = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<bool> used;
+		uint16_t numUsed = 0;
+	};
+
+	bool isCacheable(Texture2DBX* texture) const;
+	Array* createArray(uint32_t width, uint32_t height);
+	Array* getArray(uint32_t id);
+	void removeEntry(std::unordered_map<TextureBackend*, Region>::iterator it);
+
+	struct SpriteState
+	{
+		ProgramState* programState = nullptr;
+		// array bound to the state
+		uint32_t arrayId = 0;
+	};
+
+	std::unordered_map<TextureBackend*, Region> _regions;
+	std::unordered_map<const Sprite*, SpriteState> _spriteStates;
+	std::vector<Array> _arrays;
+	Program* _program = nullptr;
+	uint32_t _nextArrayId = 1;
+	bool _enabled = true;
+	uint32_t _maxTextureSize = 512;
+	uint16_t _numLayers = 8;
+	uint32_t _maxArrays = 4;
+	uint32_t _idleFrames = 600;
+};
+
+CC_BACKEND_END
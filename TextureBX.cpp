@@ -1,9 +1,21 @@
 #include "TextureBX.h"
 #include "UtilsBX.h"
+#include "TextureUploaderBX.h"
+#include "ImageUtilsBX.h"
+#include "DynamicAtlasBX.h"
+#include "TextureResidencyBX.h"
+#include "TextureTranscoderBX.h"
+#include "TextureReadbackBX.h"
+#include "RenderTargetPoolBX.h"
+#include "TextureArrayCacheBX.h"
 #include "base/CCEventListenerCustom.h"
 #include "base/CCEventDispatcher.h"
 #include "base/CCEventType.h"
 #include "base/CCDirector.h"
+#include "base/CCScheduler.h"
+#include "bimg/bimg.h"
+#include <algorithm>
+#include <unordered_set>
 
 using namespace bgfx;
 
@@ -26,66 +38,35 @@ namespace
 		}
 		return false;
 	}
-	void readBGFXTexture(TextureHandle handle, TextureHandle dst,
-		size_t tex_width , size_t tex_height, size_t bitsPerElement,
-		size_t x, size_t y, size_t width, size_t height, bool flipImage,
-		const std::function<void(const unsigned char*, size_t, size_t)>& callback)
+	// formats with 8 bits per channel can be filtered by ImageUtilsBX
+	bool isMipmapGeneratable(TextureFormat::Enum format)
 	{
-		if (!callback)
-			return;
-		if (width == 0 || height == 0 || x + width >= tex_width || y + height >= tex_height
-			|| !isValid(handle) || !isValid(dst))
+		switch (format)
 		{
-			callback(nullptr, 0, 0);
-			return;
+		case TextureFormat::RGBA8:
+		case TextureFormat::BGRA8:
+		case TextureFormat::RGB8:
+		case TextureFormat::RG8:
+		case TextureFormat::R8:
+		case TextureFormat::A8:
+			return true;
+		default: ;
 		}
-		auto image = new unsigned char[tex_width * tex_height * bitsPerElement / 8];
-		addThreadTask([=]()
-		{
-			blit(0, dst, 0, 0, handle);
-			readTexture(handle, image);
-		});
-		const auto nFrame = Director::getInstance()->getTotalFrames();
-		EventListenerCustom* listener;
-		const auto bytePerRowClipped = width * bitsPerElement / 8;
-		const auto offsetX = x * bitsPerElement / 8;
-		auto cb = [=, &image, &listener](EventCustom*)
-		{
-			const auto curFrame = Director::getInstance()->getTotalFrames();
-			if (curFrame == nFrame + 2 && image)
-			{
-				auto clipped = new unsigned char[bytePerRowClipped * height];
-				if (!flipImage)
-				{
-					for (size_t i = 0; i < height; ++i)
-					{
-						memcpy(&clipped[i * bytePerRowClipped],
-							&image[(i + y) * bytePerRowClipped + offsetX],
-							bytePerRowClipped);
-					}
-				}
-				else
-				{
-					for (size_t i = 0; i < height; ++i)
-					{
-						memcpy(&clipped[(height - i - 1) * bytePerRowClipped],
-							&image[(i + y) * bytePerRowClipped + offsetX],
-							bytePerRowClipped);
-					}
-				}
-				callback(clipped, width, height);
-				CC_SAFE_DELETE_ARRAY(clipped);
-				CC_SAFE_DELETE_ARRAY(image);
-				Director::getInstance()->getEventDispatcher()->removeEventListener(listener);
-			}
-			else if ((curFrame<nFrame || curFrame>nFrame + 2) && image)
-			{
-				CC_SAFE_DELETE_ARRAY(image);
-				Director::getInstance()->getEventDispatcher()->removeEventListener(listener);
-			}
-		};
-		listener = Director::getInstance()->getEventDispatcher()->addCustomEventListener(
-			Director::EVENT_BEFORE_DRAW, cb);
+		return false;
+	}
+	// textures holding a staging copy, released when they're not updated for a while
+	std::unordered_set<Texture2DBX*> stagingTextures;
+	uint32_t stagingIdleFrames = 120;
+	using SharedBlock = std::shared_ptr<std::vector<uint8_t>>;
+	void releaseSharedBlock(void*, void* userData)
+	{
+		delete static_cast<SharedBlock*>(userData);
+	}
+	// reference part of a block, the block is kept alive until bgfx consumed it
+	const Memory* makeSharedRef(const SharedBlock& block, size_t offset, size_t size)
+	{
+		return makeRef(block->data() + offset, uint32_t(size),
+			releaseSharedBlock, new SharedBlock(block));
 	}
 }
 
@@ -94,11 +75,13 @@ Texture2DBX::Texture2DBX(const TextureDescriptor& descriptor)
 {
 	_handle = BGFX_INVALID_HANDLE;
 	_isPow2 = ISPOW2(_width) && ISPOW2(_height);
-	_format = UtilsBX::toBXTextureFormat(descriptor.textureFormat, &_isCompressed);
+	_sourceFormat = UtilsBX::toBXTextureFormat(descriptor.textureFormat, &_isCompressed);
+	_format = TextureTranscoderBX::getTargetFormat(_sourceFormat);
 	_hasMipmaps = isMipmapEnabled(descriptor.samplerDescriptor.minFilter);
 	_sampler = UtilsBX::toBXSampler(descriptor.samplerDescriptor, _hasMipmaps, _isPow2);
+	_lastUse = Director::getInstance()->getTotalFrames();
+	// storage is not filled here, levels are zeroed only if sampled before written
 	checkTexture();
-	initWithZeros();
 
 #if CC_ENABLE_CACHE_TEXTURE_DATA
 	// Listen this event to restored texture id after coming to foreground on Android.
@@ -107,7 +90,6 @@ Texture2DBX::Texture2DBX(const TextureDescriptor& descriptor)
 	{
 		this->_dirty = true;
 		this->checkTexture();
-		this->initWithZeros();
 	});
 	Director::getInstance()->getEventDispatcher()->addEventListenerWithFixedPriority(
 		_backToForegroundListener, -1);
@@ -116,10 +98,12 @@ Texture2DBX::Texture2DBX(const TextureDescriptor& descriptor)
 
 Texture2DBX::~Texture2DBX()
 {
-	if (isValid(_handle))
-	{
-		destroy(_handle);
-	}
+	if (_pendingUploads > 0)
+		TextureUploaderBX::getInstance()->cancel(this);
+	removePacked();
+	stagingTextures.erase(this);
+	TextureResidencyBX::getInstance()->untrack(this);
+	destroyHandle();
 #if CC_ENABLE_CACHE_TEXTURE_DATA
 	Director::getInstance()->getEventDispatcher()->removeEventListener(
 		_backToForegroundListener);
@@ -131,11 +115,7 @@ void Texture2DBX::updateData(uint8_t* data,
 {
 	if (_isCompressed)
 		return;
-	checkLevel(level);
-	updateTexture2D(_handle, 0, uint8_t(level),
-		0, 0,
-		uint16_t(width), uint16_t(height),
-		copy(data, width * height * _bitsPerElement / 8));
+	upload(0, 0, width, height, level, data, width * height * _bitsPerElement / 8);
 }
 
 void Texture2DBX::updateCompressedData(uint8_t* data,
@@ -143,11 +123,10 @@ void Texture2DBX::updateCompressedData(uint8_t* data,
 {
 	if (!_isCompressed)
 		return;
-	checkLevel(level);
-	updateTexture2D(_handle, 0, uint8_t(level),
-		0, 0,
-		uint16_t(width), uint16_t(height),
-		copy(data, dataLen));
+	if (_sourceFormat != _format)
+		transcode(0, 0, width, height, level, data, dataLen);
+	else
+		upload(0, 0, width, height, level, data, dataLen);
 }
 
 void Texture2DBX::updateSubData(
@@ -157,11 +136,7 @@ void Texture2DBX::updateSubData(
 {
 	if (_isCompressed)
 		return;
-	checkLevel(level);
-	updateTexture2D(_handle, 0, uint8_t(level),
-		uint16_t(xoffset), uint16_t(yoffset),
-		uint16_t(width), uint16_t(height),
-		copy(data, width * height * _bitsPerElement / 8));
+	upload(xoffset, yoffset, width, height, level, data, width * height * _bitsPerElement / 8);
 }
 
 void Texture2DBX::updateCompressedSubData(std::size_t xoffset, std::size_t yoffset, std::size_t width,
@@ -169,11 +144,10 @@ void Texture2DBX::updateCompressedSubData(std::size_t xoffset, std::size_t yoffs
 {
 	if (!_isCompressed)
 		return;
-	checkLevel(level);
-	updateTexture2D(_handle, 0, uint8_t(level),
-		uint16_t(xoffset), uint16_t(yoffset),
-		uint16_t(width), uint16_t(height),
-		copy(data, dataLen));
+	if (_sourceFormat != _format)
+		transcode(xoffset, yoffset, width, height, level, data, dataLen);
+	else
+		upload(xoffset, yoffset, width, height, level, data, dataLen);
 }
 
 void Texture2DBX::updateSamplerDescriptor(const SamplerDescriptor& sampler)
@@ -181,36 +155,54 @@ void Texture2DBX::updateSamplerDescriptor(const SamplerDescriptor& sampler)
 	const auto hasMipmaps = isMipmapEnabled(sampler.minFilter);
 	if (hasMipmaps != _hasMipmaps)
 	{
-		_dirty = true;
-		_hasMipmaps = hasMipmaps;
+		setHasMipmaps(hasMipmaps);
 		checkTexture();
 	}
 	const auto sampler_ = UtilsBX::toBXSampler(sampler, _hasMipmaps, _isPow2);
 	if (sampler_ != _sampler)
 	{
-		//_dirty = true;
-		_samplerChanged = true;
 		_sampler = sampler_;
+		// packed region is sampled with the page sampler
+		removePacked();
 	}
 }
 
 void Texture2DBX::getBytes(std::size_t x, std::size_t y, std::size_t width, std::size_t height, bool flipImage,
 	std::function<void(const unsigned char*, std::size_t, std::size_t)> callback)
 {
-	const auto dst = createTexture2D(uint16_t(_width), uint16_t(_height), false, 1, _format, BGFX_TEXTURE_READ_BACK);
-	readBGFXTexture(_handle, dst, _width, _height, _bitsPerElement, x, y, width, height, flipImage, callback);
+	checkTexture();
+	flushStaged();
+	if (isCompacted())
+	{
+		// storage is read back as is, callers expect the source format
+		const auto src = _format;
+		const auto dst = _sourceFormat;
+		const auto onRead = callback;
+		callback = [=](const unsigned char* data, std::size_t w, std::size_t h)
+		{
+			if (!data)
+			{
+				onRead(data, w, h);
+				return;
+			}
+			const auto converted = TextureTranscoderBX::convert(data, uint32_t(w), uint32_t(h), src, dst);
+			onRead(converted.empty() ? nullptr : converted.data(), w, h);
+		};
+	}
+	TextureReadbackBX::getInstance()->read(_handle, uint32_t(_width), uint32_t(_height), _format, 0,
+		uint32_t(x), uint32_t(y), uint32_t(width), uint32_t(height), flipImage, callback);
 }
 
 void Texture2DBX::generateMipmaps()
 {
-	if (TextureUsage::RENDER_TARGET == _textureUsage)
-		return;
+	// render targets get their chain from bgfx when the framebuffer is resolved,
+	// other textures are filtered from level 0, which is read back if it's only on GPU
 	if (!_hasMipmaps)
 	{
-		_dirty = true;
-		_hasMipmaps = true;
+		setHasMipmaps(true);
 		checkTexture();
 	}
+	removePacked();
 }
 
 void Texture2DBX::updateTextureDescriptor(const TextureDescriptor& descriptor)
@@ -230,33 +222,62 @@ void Texture2DBX::updateTextureDescriptor(const TextureDescriptor& descriptor)
 		old_height != _height)
 	{
 		_dirty = true;
+		_baseLevel.reset();
+		releaseStaging();
+		_explicitMipmaps = false;
+		++_transcodeVersion;
+		removePacked();
 	}
 
-	_format = UtilsBX::toBXTextureFormat(_textureFormat, &_isCompressed);
+	_sourceFormat = UtilsBX::toBXTextureFormat(_textureFormat, &_isCompressed);
+	_format = TextureTranscoderBX::getTargetFormat(_sourceFormat);
 	auto& sampler = descriptor.samplerDescriptor;
 	const auto hasMipmaps = isMipmapEnabled(sampler.minFilter);
 	if (hasMipmaps != _hasMipmaps)
-	{
-		_dirty = true;
-		_hasMipmaps = hasMipmaps;
-	}
+		setHasMipmaps(hasMipmaps);
 	const auto sampler_ = UtilsBX::toBXSampler(sampler, _hasMipmaps, _isPow2);
 	if (sampler_ != _sampler)
 	{
-		//_dirty = true;
-		_samplerChanged = true;
 		_sampler = sampler_;
+		removePacked();
 	}
 	checkTexture();
+}
 
-	// Update data here because `updateData()` may not be invoked later.
-	// For example, a texture used as depth buffer will not invoke updateData().
-	initWithZeros();
+TextureHandle Texture2DBX::apply(int index)
+{
+	_lastUse = Director::getInstance()->getTotalFrames();
+	if (_evicted)
+		reload();
+	checkTexture();
+	if (!_sampled)
+	{
+		_sampled = true;
+		requestMipmaps();
+	}
+	if (_pendingUploads > 0 || _pendingTranscodes > 0 || _mipmapsPending || _reloading)
+		return TextureUploaderBX::getInstance()->getPlaceholder();
+	flushStaged();
+	if (_textureUsage == TextureUsage::RENDER_TARGET)
+	{
+		// cleared on GPU when first attached, the placeholder samples as zeros until then
+		if (!isLevelDefined(0))
+			return TextureUploaderBX::getInstance()->getPlaceholder();
+		return _handle;
+	}
+	for (uint8_t level = 0; level < _info.numMips; ++level)
+	{
+		if (!isLevelDefined(level))
+			initWithZeros(level);
+	}
+	return _handle;
 }
 
-void Texture2DBX::apply(int index)
+void Texture2DBX::markRendered()
 {
 	checkTexture();
+	// bgfx generates the chain of render targets
+	_definedLevels = ~0u;
 }
 
 void Texture2DBX::updateData(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t level,
@@ -269,28 +290,606 @@ void Texture2DBX::updateData(uint16_t x, uint16_t y, uint16_t width, uint16_t he
 		data);
 }
 
-void Texture2DBX::initWithZeros()
+void Texture2DBX::upload(std::size_t x, std::size_t y, std::size_t width, std::size_t height, std::size_t level,
+	const uint8_t* data, std::size_t size)
 {
-	const auto size = _width * _height * _bitsPerElement / 8;
-	if (!isValid(_handle) || size == 0)
+	checkLevel(level);
+	const bool isFullLevel0 = level == 0 && x == 0 && y == 0 && width == _width && height == _height;
+	if (isFullLevel0)
+	{
+		_evicted = false;
+		_reloading = false;
+		// staged regions and pending read backs are overwritten
+		_staged = false;
+		++_baseLevelReadVersion;
+		cancelStagingRead();
+		if (!_hasUploaded)
+			compactFormat(data);
+	}
+	// later data must fit the compact format too, otherwise the source format is restored
+	if (level == 0 && _hasUploaded && isCompacted()
+		&& !TextureTranscoderBX::canStore(data, uint32_t(width), uint32_t(height), _format))
+		restoreSourceFormat(isFullLevel0);
+	if (level == 0 && !_sampled && willGenerateMipmaps())
+		retainBaseLevel(x, y, width, height, data, size);
+	if (level == 0 && !_isCompressed)
+	{
+		// textures are packed from their first image, later ones only refresh the region
+		auto atlas = DynamicAtlasBX::getInstance();
+		auto arrays = TextureArrayCacheBX::getInstance();
+		if (!_hasUploaded && x == 0 && y == 0 && width == _width && height == _height)
+		{
+			// textures too large for the atlas may share an array with same sized ones
+			if (!atlas->add(this, data))
+				arrays->add(this, data);
+		}
+		else
+		{
+			atlas->update(this, uint32_t(x), uint32_t(y), uint32_t(width), uint32_t(height), data);
+			arrays->update(this, uint32_t(x), uint32_t(y), uint32_t(width), uint32_t(height), data);
+		}
+	}
+	if (level == 0 && !isFullLevel0 && stageSubData(x, y, width, height, data))
+	{
+		_definedLevels |= 1u;
+		_hasUploaded = true;
 		return;
-	CCASSERT(size == _info.storageSize, "size mismatch");
-	auto mem = alloc(size);
-	memset(mem->data, 0, mem->size);
+	}
+	if (level == 0 && _stagingReading)
+	{
+		// the read may miss regions uploaded after it's queued
+		PendingRegion region{ uint16_t(x), uint16_t(y), uint16_t(width), uint16_t(height) };
+		region.data.assign(data, data + width * height * _bitsPerElement / 8);
+		_pendingRegions.push_back(std::move(region));
+	}
+	// staged regions go first to keep the order of updates
+	flushStaged();
+	if (level == 0)
+		writeStaging(x, y, width, height, data);
+	defineRegion(x, y, width, height, level);
+	// copies kept on CPU are in source format, only data sent to bgfx is converted
+	std::vector<uint8_t> compacted;
+	if (isCompacted())
+	{
+		compacted = TextureTranscoderBX::convert(data, uint32_t(width), uint32_t(height), _sourceFormat, _format);
+		data = compacted.data();
+		size = compacted.size();
+	}
+	auto uploader = TextureUploaderBX::getInstance();
+	// large first uploads are streamed, later ones are queued only to keep order
+	if (_pendingUploads > 0 || (!_hasUploaded && uploader->getBudget() > 0 && size >= uploader->getStreamThreshold()))
+	{
+		_hasUploaded = true;
+		uploader->push(this, uint8_t(level),
+			uint16_t(x), uint16_t(y), uint16_t(width), uint16_t(height),
+			data, uint32_t(size), _uploadPriority);
+		return;
+	}
+	_hasUploaded = true;
+	updateTexture2D(_handle, 0, uint8_t(level),
+		uint16_t(x), uint16_t(y),
+		uint16_t(width), uint16_t(height),
+		copy(data, uint32_t(size)));
+}
+
+void Texture2DBX::transcode(std::size_t x, std::size_t y, std::size_t width, std::size_t height, std::size_t level,
+	const uint8_t* data, std::size_t size)
+{
+	checkLevel(level);
+	const auto source = std::make_shared<std::vector<uint8_t>>(data, data + size);
+	const auto src = _sourceFormat;
+	const auto dst = _format;
+	const auto version = _transcodeVersion;
+	++_pendingTranscodes;
+	retain();
+	addWorkerTask([=]()
+	{
+		const auto result = std::make_shared<std::vector<uint8_t>>(TextureTranscoderBX::transcode(
+			source->data(), source->size(), uint32_t(width), uint32_t(height), src, dst));
+		Director::getInstance()->getScheduler()->performFunctionInCocosThread([=]()
+		{
+			--_pendingTranscodes;
+			if (result->empty())
+				CCLOG("Texture2DBX: failed to transcode texture data");
+			else if (version == _transcodeVersion)
+				upload(x, y, width, height, level, result->data(), result->size());
+			release();
+		});
+	});
+}
+
+void Texture2DBX::retainBaseLevel(std::size_t x, std::size_t y, std::size_t width, std::size_t height,
+	const uint8_t* data, std::size_t size)
+{
+	if (x == 0 && y == 0 && width == _width && height == _height)
+	{
+		_baseLevel = std::make_shared<std::vector<uint8_t>>(data, data + size);
+		return;
+	}
+	if (!_baseLevel || _isCompressed)
+	{
+		_baseLevel.reset();
+		return;
+	}
+	// copy on write, a worker may be reading the old block
+	if (_baseLevel.use_count() > 1)
+		_baseLevel = std::make_shared<std::vector<uint8_t>>(*_baseLevel);
+	const auto bpp = _bitsPerElement / 8;
+	const auto pitch = width * bpp;
+	for (std::size_t i = 0; i < height; ++i)
+	{
+		memcpy(_baseLevel->data() + ((y + i) * _width + x) * bpp, data + i * pitch, pitch);
+	}
+}
+
+void Texture2DBX::restoreBaseLevel()
+{
+	if (!_baseLevel)
+		return;
+	if (!_isCompressed && _baseLevel->size() != _width * _height * _bitsPerElement / 8)
+	{
+		_baseLevel.reset();
+		return;
+	}
+	const Memory* mem = nullptr;
+	if (isCompacted())
+	{
+		const auto compacted = TextureTranscoderBX::convert(_baseLevel->data(),
+			uint32_t(_width), uint32_t(_height), _sourceFormat, _format);
+		mem = copy(compacted.data(), uint32_t(compacted.size()));
+	}
+	else
+		mem = makeSharedRef(_baseLevel, 0, _baseLevel->size());
 	updateTexture2D(_handle, 0, 0,
 		0, 0,
 		uint16_t(_width), uint16_t(_height),
 		mem);
+	_definedLevels |= 1u;
+	// the old chain is gone with the old texture
+	if (_sampled)
+		requestMipmaps();
+}
+
+void Texture2DBX::requestMipmaps()
+{
+	++_mipmapVersion;
+	_mipmapsPending = false;
+	if (!_hasMipmaps || _explicitMipmaps || !_baseLevel || _info.numMips <= 1
+		|| !isMipmapGeneratable(_format))
+	{
+		_baseLevel.reset();
+		return;
+	}
+	_mipmapsPending = true;
+	const auto version = _mipmapVersion;
+	const auto base = _baseLevel;
+	const auto width = uint32_t(_width);
+	const auto height = uint32_t(_height);
+	// level 0 of transcoded textures is kept in the target format, not the compressed one
+	const auto bpp = uint32_t(bimg::getBitsPerPixel(bimg::TextureFormat::Enum(_format)) / 8);
+	retain();
+	addWorkerTask([=]()
+	{
+		auto offsets = std::make_shared<std::vector<size_t>>();
+		auto levels = std::make_shared<std::vector<uint8_t>>(
+			ImageUtilsBX::generateMipmaps(base->data(), width, height, bpp, *offsets));
+		Director::getInstance()->getScheduler()->performFunctionInCocosThread([=]()
+		{
+			// texture may be recreated or given explicit levels meanwhile
+			if (version == _mipmapVersion && isValid(_handle))
+			{
+				uint32_t w = width;
+				uint32_t h = height;
+				const auto count = std::min(offsets->size(), size_t(_info.numMips - 1));
+				for (size_t i = 0; i < count; ++i)
+				{
+					w = std::max(w / 2, 1u);
+					h = std::max(h / 2, 1u);
+					const auto end = i + 1 < offsets->size() ? (*offsets)[i + 1] : levels->size();
+					updateTexture2D(_handle, 0, uint8_t(i + 1),
+						0, 0,
+						uint16_t(w), uint16_t(h),
+						makeSharedRef(levels, (*offsets)[i], end - (*offsets)[i]));
+					_definedLevels |= 1u << (i + 1);
+				}
+				_mipmapsPending = false;
+				_baseLevel.reset();
+			}
+			release();
+		});
+	});
+}
+
+bool Texture2DBX::willGenerateMipmaps() const
+{
+	// compact formats revert to the source format when a chain is created
+	return _hasMipmaps && !_explicitMipmaps && _textureUsage != TextureUsage::RENDER_TARGET
+		&& isMipmapGeneratable(isCompacted() ? _sourceFormat : _format);
+}
+
+void Texture2DBX::setHasMipmaps(bool hasMipmaps)
+{
+	if (hasMipmaps == _hasMipmaps)
+		return;
+	_hasMipmaps = hasMipmaps;
+	// level 0 only lives on GPU if no chain was planned, the texture is kept until it's read back
+	const bool keepLevel0 = !_dirty && !_baseLevel && isLevelDefined(0) && !_explicitMipmaps
+		&& _textureUsage != TextureUsage::RENDER_TARGET;
+	if (keepLevel0 && (!hasMipmaps || readBaseLevel()))
+		return;
+	_dirty = true;
+}
+
+bool Texture2DBX::readBaseLevel()
+{
+	if (!willGenerateMipmaps())
+		return false;
+	if (_staging.size() == _width * _height * _bitsPerElement / 8)
+	{
+		// staging already holds level 0 in source format
+		_baseLevel = std::make_shared<std::vector<uint8_t>>(_staging);
+		return false;
+	}
+	if (_isCompressed || !isValid(_handle))
+		return false;
+	flushStaged();
+	const auto version = ++_baseLevelReadVersion;
+	const auto width = _width;
+	const auto height = _height;
+	const auto format = _format;
+	const auto sourceFormat = _sourceFormat;
+	retain();
+	TextureReadbackBX::getInstance()->read(_handle, uint32_t(_width), uint32_t(_height), _format, 0,
+		0, 0, uint32_t(_width), uint32_t(_height), false,
+		[=](const unsigned char* data, std::size_t w, std::size_t h)
+	{
+		// texture may be refilled or resized meanwhile
+		if (data && version == _baseLevelReadVersion && width == _width && height == _height
+			&& !_baseLevel && !_evicted && willGenerateMipmaps())
+		{
+			if (format != sourceFormat)
+			{
+				const auto converted = TextureTranscoderBX::convert(data, uint32_t(w), uint32_t(h), format, sourceFormat);
+				_baseLevel = std::make_shared<std::vector<uint8_t>>(converted);
+			}
+			else
+				_baseLevel = std::make_shared<std::vector<uint8_t>>(data, data + w * h * _bitsPerElement / 8);
+			// recreated with a chain, level 0 is restored and the chain generated from it
+			_dirty = true;
+			checkTexture();
+		}
+		release();
+	});
+	return true;
+}
+
+bool Texture2DBX::isEvictable() const
+{
+	return _reloader && _textureUsage != TextureUsage::RENDER_TARGET && !_reloading;
+}
+
+void Texture2DBX::evict()
+{
+	if (!isValid(_handle) || !isEvictable())
+		return;
+	if (_pendingUploads > 0)
+		TextureUploaderBX::getInstance()->cancel(this);
+	destroyHandle();
+	_dirty = true;
+	_evicted = true;
+	// start over as a new texture, the reload is streamed and mipmaps are regenerated
+	_hasUploaded = false;
+	_sampled = false;
+	_baseLevel.reset();
+	++_baseLevelReadVersion;
+	releaseStaging();
+	++_mipmapVersion;
+	_mipmapsPending = false;
+	TextureResidencyBX::getInstance()->track(this, 0, TextureResidencyBX::Category::TEXTURE_2D);
+}
+
+void Texture2DBX::reload()
+{
+	_evicted = false;
+	checkTexture();
+	if (!_reloader)
+		return;
+	_reloading = true;
+	TextureResidencyBX::getInstance()->_reloadsTotal++;
+	_reloader(this);
+}
+
+void Texture2DBX::initWithZeros(uint8_t level)
+{
+	if (!isValid(_handle) || level >= _info.numMips)
+		return;
+	const auto width = std::max(uint16_t(_width >> level), uint16_t(1));
+	const auto height = std::max(uint16_t(_height >> level), uint16_t(1));
+	TextureInfo info;
+	calcTextureSize(info, width, height, 1, false, false, 1, _format);
+	auto mem = alloc(info.storageSize);
+	memset(mem->data, 0, mem->size);
+	updateTexture2D(_handle, 0, level,
+		0, 0,
+		width, height,
+		mem);
+	_definedLevels |= 1u << level;
+}
+
+void Texture2DBX::defineRegion(std::size_t x, std::size_t y, std::size_t width, std::size_t height,
+	std::size_t level)
+{
+	if (level >= 32 || isLevelDefined(uint8_t(level)))
+		return;
+	const auto levelWidth = std::max(_width >> level, std::size_t(1));
+	const auto levelHeight = std::max(_height >> level, std::size_t(1));
+	// the rest of a partially written level must not be left undefined
+	if (x != 0 || y != 0 || width < levelWidth || height < levelHeight)
+		initWithZeros(uint8_t(level));
+	_definedLevels |= 1u << level;
+}
+
+bool Texture2DBX::stageSubData(std::size_t x, std::size_t y, std::size_t width, std::size_t height,
+	const uint8_t* data)
+{
+	if (_isCompressed || _textureUsage == TextureUsage::RENDER_TARGET || _pendingUploads > 0
+		|| !isValid(_handle) || _bitsPerElement % 8 != 0)
+		return false;
+	// large regions are cheap enough to upload on their own
+	if (width * height * 4 > _width * _height)
+		return false;
+	const auto frame = Director::getInstance()->getTotalFrames();
+	const bool frequent = stagingIdleFrames == 0
+		|| (_lastRegionUpdate != 0 && frame - _lastRegionUpdate <= stagingIdleFrames);
+	_lastRegionUpdate = frame;
+	const auto levelSize = _width * _height * _bitsPerElement / 8;
+	if (_staging.empty())
+	{
+		if (_baseLevel && _baseLevel->size() == levelSize)
+			_staging = *_baseLevel;
+		else if (!isLevelDefined(0))
+		{
+			// the whole level is uploaded with the first flush
+			_staging.assign(levelSize, 0);
+			stageRegion(0, 0, _width, _height);
+		}
+		else
+		{
+			// level 0 is only on GPU, it's read back once regions keep coming
+			if (frequent && !_stagingReading)
+				readStaging();
+			return false;
+		}
+		stagingTextures.insert(this);
+	}
+	writeStaging(x, y, width, height, data);
+	stageRegion(x, y, width, height);
+	return true;
+}
+
+void Texture2DBX::stageRegion(std::size_t x, std::size_t y, std::size_t width, std::size_t height)
+{
+	if (!_staged)
+	{
+		_staged = true;
+		_stagedMinX = uint16_t(x);
+		_stagedMinY = uint16_t(y);
+		_stagedMaxX = uint16_t(x + width);
+		_stagedMaxY = uint16_t(y + height);
+		return;
+	}
+	_stagedMinX = std::min(_stagedMinX, uint16_t(x));
+	_stagedMinY = std::min(_stagedMinY, uint16_t(y));
+	_stagedMaxX = std::max(_stagedMaxX, uint16_t(x + width));
+	_stagedMaxY = std::max(_stagedMaxY, uint16_t(y + height));
+}
+
+void Texture2DBX::writeStaging(std::size_t x, std::size_t y, std::size_t width, std::size_t height,
+	const uint8_t* data)
+{
+	if (_staging.empty() || _isCompressed)
+		return;
+	const auto bpp = _bitsPerElement / 8;
+	const auto rowSize = width * bpp;
+	for (std::size_t i = 0; i < height; ++i)
+	{
+		memcpy(_staging.data() + ((y + i) * _width + x) * bpp, data + i * rowSize, rowSize);
+	}
+}
+
+void Texture2DBX::readStaging()
+{
+	if (!isValid(_handle))
+		return;
+	_stagingReading = true;
+	_pendingRegions.clear();
+	const auto version = ++_stagingReadVersion;
+	const auto width = _width;
+	const auto height = _height;
+	const auto format = _format;
+	const auto sourceFormat = _sourceFormat;
+	retain();
+	TextureReadbackBX::getInstance()->read(_handle, uint32_t(_width), uint32_t(_height), _format, 0,
+		0, 0, uint32_t(_width), uint32_t(_height), false,
+		[=](const unsigned char* data, std::size_t w, std::size_t h)
+	{
+		if (version == _stagingReadVersion)
+		{
+			_stagingReading = false;
+			if (data && width == _width && height == _height && _staging.empty() && isValid(_handle))
+			{
+				if (format != sourceFormat)
+					_staging = TextureTranscoderBX::convert(data, uint32_t(w), uint32_t(h), format, sourceFormat);
+				else
+					_staging.assign(data, data + w * h * _bitsPerElement / 8);
+				for (auto& region : _pendingRegions)
+					writeStaging(region.x, region.y, region.width, region.height, region.data.data());
+				if (!_staging.empty())
+					stagingTextures.insert(this);
+				if (_restoreSourceFormat && isCompacted() && !_staging.empty())
+				{
+					// recreated storage is filled from staging
+					_format = _sourceFormat;
+					_dirty = true;
+					checkTexture();
+				}
+			}
+			_restoreSourceFormat = false;
+			_pendingRegions.clear();
+		}
+		release();
+	});
+}
+
+void Texture2DBX::cancelStagingRead()
+{
+	++_stagingReadVersion;
+	_stagingReading = false;
+	_restoreSourceFormat = false;
+	_pendingRegions.clear();
+}
+
+void Texture2DBX::releaseStaging()
+{
+	std::vector<uint8_t>().swap(_staging);
+	_staged = false;
+	cancelStagingRead();
+	stagingTextures.erase(this);
+}
+
+void Texture2DBX::processStaging()
+{
+	const auto frame = Director::getInstance()->getTotalFrames();
+	if (stagingIdleFrames == 0 || frame % 30 != 0)
+		return;
+	for (auto it = stagingTextures.begin(); it != stagingTextures.end();)
+	{
+		const auto texture = *it;
+		++it;
+		if (frame - texture->_lastRegionUpdate > stagingIdleFrames)
+		{
+			texture->flushStaged();
+			texture->releaseStaging();
+		}
+	}
+}
+
+void Texture2DBX::setStagingIdleFrames(uint32_t frames)
+{
+	stagingIdleFrames = frames;
+}
+
+uint32_t Texture2DBX::getStagingIdleFrames()
+{
+	return stagingIdleFrames;
+}
+
+void Texture2DBX::flushStaged()
+{
+	if (!_staged)
+		return;
+	_staged = false;
+	if (!isValid(_handle) || _staging.empty())
+		return;
+	// one upload of the bounding region instead of one per sub update
+	const auto bpp = _bitsPerElement / 8;
+	const auto width = std::size_t(_stagedMaxX - _stagedMinX);
+	const auto height = std::size_t(_stagedMaxY - _stagedMinY);
+	const auto rowSize = width * bpp;
+	std::vector<uint8_t> region(rowSize * height);
+	for (std::size_t i = 0; i < height; ++i)
+	{
+		memcpy(region.data() + i * rowSize,
+			_staging.data() + ((_stagedMinY + i) * _width + _stagedMinX) * bpp, rowSize);
+	}
+	if (isCompacted())
+		region = TextureTranscoderBX::convert(region.data(), uint32_t(width), uint32_t(height), _sourceFormat, _format);
+	updateTexture2D(_handle, 0, 0,
+		_stagedMinX, _stagedMinY,
+		uint16_t(width), uint16_t(height),
+		copy(region.data(), uint32_t(region.size())));
+}
+
+void Texture2DBX::compactFormat(const uint8_t* data)
+{
+	// mipmaps are generated from 8 bits channels, render targets are written by GPU
+	if (_isCompressed || _sourceFormat != TextureFormat::RGBA8 || _hasMipmaps
+		|| _textureUsage == TextureUsage::RENDER_TARGET)
+		return;
+	// blank images are filled later, such as atlas pages
+	const auto size = size_t(_width) * _height * 4;
+	if (!data || std::all_of(data, data + size, [](uint8_t value) { return value == 0; }))
+		return;
+	const auto format = TextureTranscoderBX::getCompactFormat(data, uint32_t(_width), uint32_t(_height));
+	if (format == _format)
+		return;
+	_format = format;
+	_dirty = true;
+	checkTexture();
+}
+
+void Texture2DBX::restoreSourceFormat(bool replaced)
+{
+	// queued data is in the compact format, it's read back with the rest of level 0
+	if (_pendingUploads > 0)
+		TextureUploaderBX::getInstance()->flush(this);
+	const auto levelSize = _width * _height * _bitsPerElement / 8;
+	if (replaced || !isLevelDefined(0) || _staging.size() == levelSize)
+	{
+		// nothing to keep, or staging holds level 0 already
+		_format = _sourceFormat;
+		_dirty = true;
+		checkTexture();
+		return;
+	}
+	if (!_stagingReading)
+		readStaging();
+	_restoreSourceFormat = _stagingReading;
+}
+
+void Texture2DBX::removePacked()
+{
+	// copies in atlas pages and texture arrays
+	DynamicAtlasBX::getInstance()->remove(this);
+	TextureArrayCacheBX::getInstance()->remove(this);
+}
+
+void Texture2DBX::destroyHandle()
+{
+	if (!isValid(_handle))
+		return;
+	auto pool = RenderTargetPoolBX::getInstance();
+	if (_pooled)
+		pool->releaseTexture(_handle);
+	else
+	{
+		pool->invalidate(_handle);
+		destroy(_handle);
+	}
+	_handle = BGFX_INVALID_HANDLE;
+	_pooled = false;
+	// contents of the old storage are gone
+	cancelStagingRead();
 }
 
 void Texture2DBX::checkLevel(std::size_t level)
 {
-	if (!_hasMipmaps && level > 0)
+	if (level == 0)
+		return;
+	if (!_explicitMipmaps)
+	{
+		// explicit levels replace the generated chain
+		_explicitMipmaps = true;
+		_dirty = _dirty || _info.numMips <= 1;
+		++_mipmapVersion;
+		_mipmapsPending = false;
+	}
+	if (!_hasMipmaps)
 	{
 		_dirty = true;
 		_hasMipmaps = true;
-		checkTexture();
 	}
+	checkTexture();
 }
 
 void Texture2DBX::checkTexture()
@@ -302,18 +901,38 @@ void Texture2DBX::checkTexture()
 	if (isValid(_handle))
 	{
 		CCLOG("destory old texture");
-		destroy(_handle);
+		destroyHandle();
 	}
+	// compact formats can't have a generated chain
+	if (_hasMipmaps && isCompacted())
+		_format = _sourceFormat;
 	//NOTE: BGFX_TEXTURE_READ_BACK is not for TextureUsage::READ
 	auto flags = BGFX_TEXTURE_NONE;
 	if (_textureUsage == TextureUsage::RENDER_TARGET)
 		flags |= BGFX_TEXTURE_RT;
-	flags |= _sampler;
-	_hasMipmaps = false;
-	calcTextureSize(_info, _width, _height, 1, false, _hasMipmaps, 1, _format);
-	_handle = createTexture2D(_width, _height, _hasMipmaps, 1, _format, flags);
+	// sampler flags are passed when the texture is bound, so they are not part of the storage
+	// a chain is only allocated when its contents can be provided
+	const auto hasMips = _hasMipmaps && (_explicitMipmaps
+		|| _textureUsage == TextureUsage::RENDER_TARGET || isMipmapGeneratable(_format));
+	calcTextureSize(_info, _width, _height, 1, false, hasMips, 1, _format);
+	// render targets are aliased from the pool, their contents are undefined either way
+	_pooled = _textureUsage == TextureUsage::RENDER_TARGET;
+	if (_pooled)
+		_handle = RenderTargetPoolBX::getInstance()->acquireTexture(
+			uint16_t(_width), uint16_t(_height), hasMips, _format, flags);
+	else
+		_handle = createTexture2D(_width, _height, hasMips, 1, _format, flags);
+	_definedLevels = 0;
 	_dirty = false;
-	_samplerChanged = false;
+	TextureResidencyBX::getInstance()->track(this, _info.storageSize,
+		_textureUsage == TextureUsage::RENDER_TARGET ?
+		TextureResidencyBX::Category::RENDER_TARGET : TextureResidencyBX::Category::TEXTURE_2D);
+	restoreBaseLevel();
+	if (!_staging.empty())
+	{
+		_definedLevels |= 1u;
+		stageRegion(0, 0, _width, _height);
+	}
 }
 
 TextureCubeBX::TextureCubeBX(const TextureDescriptor& descriptor)
@@ -341,8 +960,10 @@ TextureCubeBX::TextureCubeBX(const TextureDescriptor& descriptor)
 
 TextureCubeBX::~TextureCubeBX()
 {
+	TextureResidencyBX::getInstance()->untrack(this);
 	if (isValid(_handle))
 	{
+		RenderTargetPoolBX::getInstance()->invalidate(_handle);
 		destroy(_handle);
 	}
 #if CC_ENABLE_CACHE_TEXTURE_DATA
@@ -360,40 +981,42 @@ void TextureCubeBX::updateSamplerDescriptor(const SamplerDescriptor& sampler)
 		_hasMipmaps = hasMipmaps;
 		checkTexture();
 	}
-	const auto sampler_ = UtilsBX::toBXSampler(sampler, _hasMipmaps, _isPow2);
-	if (sampler_ != _sampler)
-	{
-		//_dirty = true;
-		_samplerChanged = true;
-		_sampler = sampler_;
-	}
+	_sampler = UtilsBX::toBXSampler(sampler, _hasMipmaps, _isPow2);
 }
 
 void TextureCubeBX::updateFaceData(TextureCubeFace side, void* data)
 {
+	makeMutable();
 	checkTexture();
+	const auto size = _width * _height * _bitsPerElement / 8;
+	retainFace(side, (const uint8_t*)data, size);
 	updateTextureCube(_handle, 0, uint8_t(side), 0, 0, 0, _width, _height,
-		copy(data, _width * _height * _bitsPerElement / 8));
+		copy(data, size));
+	_hasUploaded = true;
+	// the block is stale now, faces are retained instead until sampled
+	if (_sampled)
+		_block.reset();
 }
 
 void TextureCubeBX::getBytes(std::size_t x, std::size_t y, std::size_t width, std::size_t height, bool flipImage,
 	std::function<void(const unsigned char*, std::size_t, std::size_t)> callback)
 {
-	//TODO: need check
-	const auto dst = createTexture2D(uint16_t(_width), uint16_t(_height), false, 1, _format, BGFX_TEXTURE_READ_BACK);
-	readBGFXTexture(_handle, dst, _width, _height, _bitsPerElement, x, y, width, height, flipImage, callback);
+	// reads the first face
+	checkTexture();
+	TextureReadbackBX::getInstance()->read(_handle, uint32_t(_width), uint32_t(_height), _format, 0,
+		uint32_t(x), uint32_t(y), uint32_t(width), uint32_t(height), flipImage, callback);
 }
 
 void TextureCubeBX::generateMipmaps()
 {
-	if (TextureUsage::RENDER_TARGET == _textureUsage)
-		return;
 	if (!_hasMipmaps)
 	{
 		_dirty = true;
 		_hasMipmaps = true;
 		checkTexture();
 	}
+	if (TextureUsage::RENDER_TARGET != _textureUsage && _sampled && !_mipmapsPending)
+		CCLOG("TextureCubeBX: can't generate mipmaps after the texture is sampled");
 }
 
 void TextureCubeBX::updateTextureDescriptor(const TextureDescriptor& descriptor)
@@ -402,7 +1025,13 @@ void TextureCubeBX::updateTextureDescriptor(const TextureDescriptor& descriptor)
 	const auto old_textureFormat = _textureFormat;
 	_textureFormat = descriptor.textureFormat;
 	if (old_textureFormat != _textureFormat)
+	{
 		_dirty = true;
+		_faces = {};
+		_block.reset();
+		_immutable = false;
+		_explicitMipmaps = false;
+	}
 	_format = UtilsBX::toBXTextureFormat(_textureFormat, &_isCompressed);
 	auto& sampler = descriptor.samplerDescriptor;
 	const auto hasMipmaps = isMipmapEnabled(sampler.minFilter);
@@ -411,26 +1040,236 @@ void TextureCubeBX::updateTextureDescriptor(const TextureDescriptor& descriptor)
 		_dirty = true;
 		_hasMipmaps = hasMipmaps;
 	}
-	const auto sampler_ = UtilsBX::toBXSampler(sampler, _hasMipmaps, _isPow2);
-	if (sampler_ != _sampler)
-	{
-		//_dirty = true;
-		_samplerChanged = true;
-		_sampler = sampler_;
-	}
+	_sampler = UtilsBX::toBXSampler(sampler, _hasMipmaps, _isPow2);
 	checkTexture();
 }
 
-void TextureCubeBX::apply(int index)
+TextureHandle TextureCubeBX::apply(int index)
 {
 	checkTexture();
+	if (!_sampled)
+	{
+		_sampled = true;
+		requestMipmaps();
+	}
+	if (_mipmapsPending)
+		return TextureUploaderBX::getInstance()->getPlaceholder();
+	return _handle;
 }
 
 void TextureCubeBX::updateData(TextureCubeFace side, const Memory* data)
 {
 	assert(data->size == _width * _height * _bitsPerElement / 8);
+	makeMutable();
 	checkTexture();
+	retainFace(side, data->data, data->size);
 	updateTextureCube(_handle, 0, uint8_t(side), 0, 0, 0, _width, _height, data);
+	_hasUploaded = true;
+	if (_sampled)
+		_block.reset();
+}
+
+void TextureCubeBX::updateData(const uint8_t* data, std::size_t size, uint8_t numMips, bool immutable)
+{
+	const bool hasMips = numMips > 1;
+	if (hasMips && numMips != ImageUtilsBX::getNumMips(_width, _height))
+	{
+		CCLOG("TextureCubeBX: mip chain of %d levels is incomplete", numMips);
+		return;
+	}
+	TextureInfo info;
+	calcTextureSize(info, _width, _width, 1, true, hasMips, 1, _format);
+	if (!data || size != info.storageSize)
+	{
+		CCLOG("TextureCubeBX: expect %u bytes for all faces, got %u", info.storageSize, uint32_t(size));
+		return;
+	}
+	// new data replaces retained faces and pending mipmaps
+	++_mipmapVersion;
+	_mipmapsPending = false;
+	_faces = {};
+	if (hasMips && !_explicitMipmaps)
+	{
+		_explicitMipmaps = true;
+		_hasMipmaps = true;
+		_dirty = true;
+	}
+	if (!hasMips && _explicitMipmaps)
+	{
+		// the chain given before doesn't match level 0 anymore, it's generated or dropped
+		_explicitMipmaps = false;
+		_dirty = true;
+	}
+	if (!hasMips && _hasMipmaps && !_explicitMipmaps && isMipmapGeneratable(_format))
+	{
+		// faces are needed separately for generation
+		const auto faceSize = size / _faces.size();
+		_block.reset();
+		makeMutable();
+		checkTexture();
+		for (size_t i = 0; i < _faces.size(); ++i)
+		{
+			retainFace(TextureCubeFace(i), data + faceSize * i, faceSize);
+			updateTextureCube(_handle, 0, uint8_t(i), 0, 0, 0, _width, _height,
+				copy(data + faceSize * i, uint32_t(faceSize)));
+		}
+		_hasUploaded = true;
+		return;
+	}
+	const auto block = std::make_shared<std::vector<uint8_t>>(data, data + size);
+	if (immutable && !_hasUploaded && _textureUsage != TextureUsage::RENDER_TARGET)
+	{
+		// everything is provided before first use, create with data, block is kept for recreation
+		if (isValid(_handle))
+		{
+			RenderTargetPoolBX::getInstance()->invalidate(_handle);
+			destroy(_handle);
+			_handle = BGFX_INVALID_HANDLE;
+		}
+		_block = block;
+		_immutable = true;
+		_hasUploaded = true;
+		checkTexture();
+		return;
+	}
+	_block = block;
+	_hasUploaded = true;
+	makeMutable();
+	// a recreated texture is filled from the block already
+	const bool recreated = _dirty || !isValid(_handle);
+	checkTexture();
+	if (!recreated)
+		uploadBlock();
+	if (_sampled)
+		_block.reset();
+}
+
+void TextureCubeBX::makeMutable()
+{
+	if (!_immutable)
+		return;
+	// recreated from the kept block in `checkTexture()`
+	_immutable = false;
+	_dirty = true;
+}
+
+void TextureCubeBX::uploadBlock()
+{
+	if (!_block)
+		return;
+	// a block of level 0 only fills level 0 when mipmaps are enabled later
+	uint8_t numMips = _numMips;
+	TextureInfo info;
+	calcTextureSize(info, _width, _width, 1, true, numMips > 1, 1, _format);
+	if (_block->size() != info.storageSize)
+	{
+		numMips = 1;
+		calcTextureSize(info, _width, _width, 1, true, false, 1, _format);
+	}
+	if (_block->size() != info.storageSize)
+	{
+		_block.reset();
+		return;
+	}
+	// faces are in order, each followed by its mips
+	size_t offset = 0;
+	for (uint8_t side = 0; side < 6; ++side)
+	{
+		for (uint8_t level = 0; level < numMips; ++level)
+		{
+			const auto s = std::max(uint32_t(_width) >> level, 1u);
+			TextureInfo levelInfo;
+			calcTextureSize(levelInfo, uint16_t(s), uint16_t(s), 1, false, false, 1, _format);
+			updateTextureCube(_handle, 0, side, level, 0, 0, uint16_t(s), uint16_t(s),
+				makeSharedRef(_block, offset, levelInfo.storageSize));
+			offset += levelInfo.storageSize;
+		}
+	}
+}
+
+void TextureCubeBX::retainFace(TextureCubeFace side, const uint8_t* data, std::size_t size)
+{
+	if (_sampled || _textureUsage == TextureUsage::RENDER_TARGET || size_t(side) >= _faces.size())
+		return;
+	_faces[size_t(side)] = std::make_shared<std::vector<uint8_t>>(data, data + size);
+}
+
+void TextureCubeBX::restoreFaces()
+{
+	bool restored = false;
+	for (size_t i = 0; i < _faces.size(); ++i)
+	{
+		auto& face = _faces[i];
+		if (!face)
+			continue;
+		if (face->size() != _width * _height * _bitsPerElement / 8)
+		{
+			face.reset();
+			continue;
+		}
+		updateTextureCube(_handle, 0, uint8_t(i), 0, 0, 0, _width, _height,
+			makeSharedRef(face, 0, face->size()));
+		restored = true;
+	}
+	if (restored && _sampled)
+		requestMipmaps();
+}
+
+void TextureCubeBX::requestMipmaps()
+{
+	++_mipmapVersion;
+	_mipmapsPending = false;
+	bool complete = true;
+	for (auto& face : _faces)
+		complete = complete && face;
+	if (!_hasMipmaps || _explicitMipmaps || !complete || _numMips <= 1 || !isMipmapGeneratable(_format))
+	{
+		_faces = {};
+		if (!_immutable)
+			_block.reset();
+		return;
+	}
+	_mipmapsPending = true;
+	const auto version = _mipmapVersion;
+	const auto faces = _faces;
+	const auto size = uint32_t(_width);
+	const auto bpp = uint32_t(_bitsPerElement / 8);
+	retain();
+	addWorkerTask([=]()
+	{
+		using Chain = std::pair<std::vector<size_t>, SharedBlock>;
+		auto chains = std::make_shared<std::array<Chain, 6>>();
+		for (size_t i = 0; i < faces.size(); ++i)
+		{
+			auto& chain = (*chains)[i];
+			chain.second = std::make_shared<std::vector<uint8_t>>(
+				ImageUtilsBX::generateMipmaps(faces[i]->data(), size, size, bpp, chain.first));
+		}
+		Director::getInstance()->getScheduler()->performFunctionInCocosThread([=]()
+		{
+			if (version == _mipmapVersion && isValid(_handle))
+			{
+				for (size_t i = 0; i < chains->size(); ++i)
+				{
+					auto& offsets = (*chains)[i].first;
+					auto& levels = (*chains)[i].second;
+					uint32_t s = size;
+					const auto count = std::min(offsets.size(), size_t(_numMips - 1));
+					for (size_t j = 0; j < count; ++j)
+					{
+						s = std::max(s / 2, 1u);
+						const auto end = j + 1 < offsets.size() ? offsets[j + 1] : levels->size();
+						updateTextureCube(_handle, 0, uint8_t(i), uint8_t(j + 1),
+							0, 0, uint16_t(s), uint16_t(s),
+							makeSharedRef(levels, offsets[j], end - offsets[j]));
+					}
+				}
+				_mipmapsPending = false;
+				_faces = {};
+			}
+			release();
+		});
+	});
 }
 
 void TextureCubeBX::checkTexture()
@@ -440,13 +1279,185 @@ void TextureCubeBX::checkTexture()
 	if (_width == 0)
 		return;
 	if (isValid(_handle))
+	{
+		RenderTargetPoolBX::getInstance()->invalidate(_handle);
 		destroy(_handle);
+	}
 	auto flags = BGFX_TEXTURE_NONE;
 	if (_textureUsage == TextureUsage::RENDER_TARGET)
 		flags |= BGFX_TEXTURE_RT;
-	_handle = createTextureCube(_width, _hasMipmaps, 1, _format, flags | _sampler);
+	const auto hasMips = _hasMipmaps && (_explicitMipmaps
+		|| _textureUsage == TextureUsage::RENDER_TARGET || isMipmapGeneratable(_format));
+	_numMips = hasMips ? ImageUtilsBX::getNumMips(_width, _height) : 1;
+	TextureInfo info;
+	calcTextureSize(info, _width, _width, 1, true, hasMips, 1, _format);
+	if (_immutable && (!_block || _block->size() != info.storageSize))
+		_immutable = false;
+	if (_immutable)
+		_handle = createTextureCube(_width, hasMips, 1, _format, flags,
+			makeSharedRef(_block, 0, _block->size()));
+	else
+		_handle = createTextureCube(_width, hasMips, 1, _format, flags);
+	_dirty = false;
+	TextureResidencyBX::getInstance()->track(this, info.storageSize,
+		TextureResidencyBX::Category::TEXTURE_CUBE);
+	if (!_immutable)
+	{
+		uploadBlock();
+		restoreFaces();
+	}
+}
+
+Texture2DArrayBX::Texture2DArrayBX(const TextureDescriptor& descriptor, uint16_t numLayers)
+: Texture2DBackend(descriptor)
+{
+	_textureType = TEXTURE_2D_ARRAY;
+	_handle = BGFX_INVALID_HANDLE;
+	_numLayers = std::max(numLayers, uint16_t(1));
+	_isPow2 = ISPOW2(_width) && ISPOW2(_height);
+	_format = UtilsBX::toBXTextureFormat(descriptor.textureFormat, &_isCompressed);
+	_hasMipmaps = isMipmapEnabled(descriptor.samplerDescriptor.minFilter);
+	_sampler = UtilsBX::toBXSampler(descriptor.samplerDescriptor, _hasMipmaps, _isPow2);
+#if CC_ENABLE_CACHE_TEXTURE_DATA
+	_backToForegroundListener = EventListenerCustom::create(EVENT_RENDERER_RECREATED,
+		[this](EventCustom*)
+	{
+		this->_dirty = true;
+		this->checkTexture();
+	});
+	Director::getInstance()->getEventDispatcher()->addEventListenerWithFixedPriority(
+		_backToForegroundListener, -1);
+#endif
+}
+
+Texture2DArrayBX::~Texture2DArrayBX()
+{
+	TextureResidencyBX::getInstance()->untrack(this);
+	if (isValid(_handle))
+	{
+		destroy(_handle);
+	}
+#if CC_ENABLE_CACHE_TEXTURE_DATA
+	Director::getInstance()->getEventDispatcher()->removeEventListener(
+		_backToForegroundListener);
+#endif
+}
+
+void Texture2DArrayBX::updateData(uint8_t* data, std::size_t width, std::size_t height, std::size_t level)
+{
+	if (_isCompressed)
+		return;
+	updateLayer(0, 0, 0, width, height, level, data, width * height * _bitsPerElement / 8);
+}
+
+void Texture2DArrayBX::updateCompressedData(uint8_t* data, std::size_t width, std::size_t height,
+	std::size_t dataLen, std::size_t level)
+{
+	if (!_isCompressed)
+		return;
+	updateLayer(0, 0, 0, width, height, level, data, dataLen);
+}
+
+void Texture2DArrayBX::updateSubData(std::size_t xoffset, std::size_t yoffset, std::size_t width, std::size_t height,
+	std::size_t level, uint8_t* data)
+{
+	if (_isCompressed)
+		return;
+	updateLayer(0, xoffset, yoffset, width, height, level, data, width * height * _bitsPerElement / 8);
+}
+
+void Texture2DArrayBX::updateCompressedSubData(std::size_t xoffset, std::size_t yoffset,
+	std::size_t width, std::size_t height, std::size_t dataLen, std::size_t level, uint8_t* data)
+{
+	if (!_isCompressed)
+		return;
+	updateLayer(0, xoffset, yoffset, width, height, level, data, dataLen);
+}
+
+void Texture2DArrayBX::updateSamplerDescriptor(const SamplerDescriptor& sampler)
+{
+	const auto hasMipmaps = isMipmapEnabled(sampler.minFilter);
+	if (hasMipmaps != _hasMipmaps)
+	{
+		_dirty = true;
+		_hasMipmaps = hasMipmaps;
+		checkTexture();
+	}
+	_sampler = UtilsBX::toBXSampler(sampler, _hasMipmaps, _isPow2);
+}
+
+void Texture2DArrayBX::getBytes(std::size_t x, std::size_t y, std::size_t width, std::size_t height, bool flipImage,
+	std::function<void(const unsigned char*, std::size_t, std::size_t)> callback)
+{
+	checkTexture();
+	TextureReadbackBX::getInstance()->read(_handle, uint32_t(_width), uint32_t(_height), _format, 0,
+		uint32_t(x), uint32_t(y), uint32_t(width), uint32_t(height), flipImage, callback);
+}
+
+void Texture2DArrayBX::generateMipmaps()
+{
+	CCLOG("Texture2DArrayBX: mipmaps can't be generated");
+}
+
+void Texture2DArrayBX::updateTextureDescriptor(const TextureDescriptor& descriptor)
+{
+	const auto old_textureFormat = _textureFormat;
+	const auto old_width = _width;
+	const auto old_height = _height;
+	TextureBackend::updateTextureDescriptor(descriptor);
+	// keep the type after the update of base
+	_textureType = TEXTURE_2D_ARRAY;
+	if (old_textureFormat != _textureFormat || old_width != _width || old_height != _height)
+		_dirty = true;
+	_isPow2 = ISPOW2(_width) && ISPOW2(_height);
+	_format = UtilsBX::toBXTextureFormat(_textureFormat, &_isCompressed);
+	updateSamplerDescriptor(descriptor.samplerDescriptor);
+	checkTexture();
+}
+
+void Texture2DArrayBX::updateLayer(uint16_t layer, std::size_t x, std::size_t y, std::size_t width,
+	std::size_t height, std::size_t level, const uint8_t* data, std::size_t size)
+{
+	CCASSERT(layer < _numLayers, "layer out of range");
+	if (layer >= _numLayers || !data)
+		return;
+	if (level > 0 && !_hasMipmaps)
+	{
+		_dirty = true;
+		_hasMipmaps = true;
+	}
+	checkTexture();
+	updateTexture2D(_handle, layer, uint8_t(level),
+		uint16_t(x), uint16_t(y),
+		uint16_t(width), uint16_t(height),
+		copy(data, uint32_t(size)));
+}
+
+TextureHandle Texture2DArrayBX::apply(int index)
+{
+	checkTexture();
+	return _handle;
+}
+
+void Texture2DArrayBX::checkTexture()
+{
+	if (!_dirty && isValid(_handle))
+		return;
+	if (_width * _height == 0)
+		return;
+	const bool recreated = isValid(_handle);
+	if (recreated)
+		destroy(_handle);
+	CCASSERT(getCaps()->supported & BGFX_CAPS_TEXTURE_2D_ARRAY, "texture array is not supported");
+	_handle = createTexture2D(uint16_t(_width), uint16_t(_height), _hasMipmaps, _numLayers, _format);
 	_dirty = false;
-	_samplerChanged = false;
+	// layers are lost, textures copied into them are drawn from their own storage again
+	if (recreated)
+		TextureArrayCacheBX::getInstance()->invalidate(this);
+	TextureInfo info;
+	calcTextureSize(info, uint16_t(_width), uint16_t(_height), 1, false, _hasMipmaps, _numLayers, _format);
+	TextureResidencyBX::getInstance()->track(this, info.storageSize,
+		TextureResidencyBX::Category::ATLAS);
 }
 
 CC_BACKEND_END
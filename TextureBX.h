@@ -2,9 +2,16 @@
 #include "renderer/backend/Texture.h"
 #include "base/CCEventListenerCustom.h"
 #include "bgfx/bgfx.h"
+#include <array>
+#include <functional>
+#include <memory>
+#include <vector>
 
 CC_BACKEND_BEGIN
 
+/** Type of Texture2DArrayBX, extends `TextureType` which has no array type. */
+constexpr TextureType TEXTURE_2D_ARRAY = TextureType(2);
+
 class Texture2DBX : public Texture2DBackend
 {
 public:
@@ -91,29 +98,136 @@ public:
 	/**
 	 * Set texture to pipeline
 	 * @param index Specifies the texture image unit selector.
+	 * @return The texture to bind, a placeholder if texture is not resident.
 	 */
-	void apply(int index);
+	bgfx::TextureHandle apply(int index);
 
 	void updateData(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
 		uint8_t level, const bgfx::Memory* data);
 
+	/**
+	 * Set priority of queued uploads, higher priority is uploaded first.
+	 */
+	void setUploadPriority(int priority) { _uploadPriority = priority; }
+	int getUploadPriority() const { return _uploadPriority; }
+	/** Texture is resident when it is not evicted and has no queued upload, transcoding or mipmap generation. */
+	bool isResident() const
+	{
+		return _pendingUploads == 0 && _pendingTranscodes == 0 && !_mipmapsPending && !_evicted && !_reloading;
+	}
+
+	/**
+	 * Set function to refill level 0 through `updateData()` after the texture is evicted.
+	 * Texture can only be evicted when it has a reloader.
+	 */
+	using Reloader = std::function<void(Texture2DBX*)>;
+	void setReloader(const Reloader& reloader) { _reloader = reloader; }
+	bool hasReloader() const { return _reloader != nullptr; }
+	bool isEvictable() const;
+	/** Frame number of last `apply()`. */
+	uint32_t getLastUse() const { return _lastUse; }
+
+	/** Level has been written since the storage was created. */
+	bool isLevelDefined(uint8_t level) const { return level < 32 && (_definedLevels >> level & 1u) != 0; }
+	/**
+	 * Mark all levels as defined, invoked when the render target is attached and cleared.
+	 */
+	void markRendered();
+
 	uint32_t getSamplerFlag() const { return _sampler; }
-	bool isSamplerChanged() const { return _samplerChanged; }
 	void getSize(uint32_t& width, uint32_t& height) const { width = _width; height = _height; }
 
+	/**
+	 * Release staging copies of textures which are not updated by regions recently.
+	 * Should be invoked once per frame.
+	 */
+	static void processStaging();
+	/** Number of frames without region updates before a staging copy is released, 0 means never. */
+	static void setStagingIdleFrames(uint32_t frames);
+	static uint32_t getStagingIdleFrames();
+
 private:
-	void initWithZeros();
+	void evict();
+	void reload();
+	void initWithZeros(uint8_t level);
+	void defineRegion(std::size_t x, std::size_t y, std::size_t width, std::size_t height, std::size_t level);
 	void checkLevel(std::size_t level);
 	void checkTexture();
+	void destroyHandle();
+	void upload(std::size_t x, std::size_t y, std::size_t width, std::size_t height, std::size_t level,
+		const uint8_t* data, std::size_t size);
+	void transcode(std::size_t x, std::size_t y, std::size_t width, std::size_t height, std::size_t level,
+		const uint8_t* data, std::size_t size);
+	void retainBaseLevel(std::size_t x, std::size_t y, std::size_t width, std::size_t height,
+		const uint8_t* data, std::size_t size);
+	void restoreBaseLevel();
+	void requestMipmaps();
+	bool willGenerateMipmaps() const;
+	void setHasMipmaps(bool hasMipmaps);
+	bool readBaseLevel();
+	void removePacked();
+	bool stageSubData(std::size_t x, std::size_t y, std::size_t width, std::size_t height, const uint8_t* data);
+	void stageRegion(std::size_t x, std::size_t y, std::size_t width, std::size_t height);
+	void writeStaging(std::size_t x, std::size_t y, std::size_t width, std::size_t height, const uint8_t* data);
+	void readStaging();
+	void cancelStagingRead();
+	void releaseStaging();
+	void flushStaged();
+	void compactFormat(const uint8_t* data);
+	void restoreSourceFormat(bool replaced);
+	bool isCompacted() const { return !_isCompressed && _format != _sourceFormat; }
 	
 	bgfx::TextureHandle _handle;
+	// storage is owned by RenderTargetPoolBX
+	bool _pooled = false;
 	bgfx::TextureFormat::Enum _format = bgfx::TextureFormat::RGBA8;
+	// format of incoming data, differs from _format when it's transcoded or compacted
+	bgfx::TextureFormat::Enum _sourceFormat = bgfx::TextureFormat::RGBA8;
+	uint32_t _pendingTranscodes = 0;
+	uint32_t _transcodeVersion = 0;
 	bgfx::TextureInfo _info;
 	uint32_t _sampler = 0;
-	bool _samplerChanged = false;
 	bool _isPow2 = false;
 	bool _dirty = true;
+	bool _hasUploaded = false;
+	// bit per level, storage is created without data
+	uint32_t _definedLevels = 0;
+	int _uploadPriority = 0;
+	uint32_t _pendingUploads = 0;
+	// level 0 data kept until the texture is sampled, only if a chain is generated from it
+	std::shared_ptr<std::vector<uint8_t>> _baseLevel;
+	uint32_t _baseLevelReadVersion = 0;
+	bool _sampled = false;
+	bool _explicitMipmaps = false;
+	bool _mipmapsPending = false;
+	uint32_t _mipmapVersion = 0;
+	// copy of level 0 for textures updated by small regions, regions are uploaded together on first use
+	std::vector<uint8_t> _staging;
+	bool _staged = false;
+	uint16_t _stagedMinX = 0;
+	uint16_t _stagedMinY = 0;
+	uint16_t _stagedMaxX = 0;
+	uint16_t _stagedMaxY = 0;
+	// frame of last region update, staging is released when it's idle
+	uint32_t _lastRegionUpdate = 0;
+	// regions uploaded while level 0 is read back to seed staging, written over the read data
+	struct PendingRegion
+	{
+		uint16_t x, y, width, height;
+		std::vector<uint8_t> data;
+	};
+	std::vector<PendingRegion> _pendingRegions;
+	bool _stagingReading = false;
+	uint32_t _stagingReadVersion = 0;
+	// recreated in the source format when the read back for staging is done
+	bool _restoreSourceFormat = false;
+	Reloader _reloader;
+	uint32_t _lastUse = 0;
+	bool _evicted = false;
+	bool _reloading = false;
 	EventListener* _backToForegroundListener = nullptr;
+	friend class TextureUploaderBX;
+	friend class TextureResidencyBX;
 };
 
 /**
@@ -168,13 +282,104 @@ public:
 	/**
 	 * Set texture to pipeline
 	 * @param index Specifies the texture image unit selector.
+	 * @return The texture to bind, a placeholder if mipmaps are being generated.
 	 */
-	void apply(int index);
+	bgfx::TextureHandle apply(int index);
 
 	void updateData(TextureCubeFace side, const bgfx::Memory* data);
 
+	/**
+	 * Update all faces in one call.
+	 * @param data Specifies faces in order of `TextureCubeFace`, each followed by its mips.
+	 * @param size Specifies the size of data in bytes.
+	 * @param numMips Specifies number of levels of each face, 1 or the full chain.
+	 * @param immutable Specifies to create the texture immutable with the data if it has not been updated before.
+	 * The data is then kept on CPU, so that the texture can be recreated when it's changed later.
+	 */
+	void updateData(const uint8_t* data, std::size_t size, uint8_t numMips = 1, bool immutable = false);
+
+	uint32_t getSamplerFlag() const { return _sampler; }
+	void getSize(uint32_t& width, uint32_t& height) const { width = _width; height = _height; }
+
+private:
+	void checkTexture();
+	void retainFace(TextureCubeFace side, const uint8_t* data, std::size_t size);
+	void restoreFaces();
+	void requestMipmaps();
+	void makeMutable();
+	void uploadBlock();
+
+	bgfx::TextureHandle _handle;
+	bgfx::TextureFormat::Enum _format = bgfx::TextureFormat::RGBA8;
+	uint32_t _sampler = 0;
+	bool _isPow2 = false;
+	bool _dirty = true;
+	// face data kept until the texture is sampled, for mipmap generation and recreation
+	std::array<std::shared_ptr<std::vector<uint8_t>>, 6> _faces;
+	// data of all faces from the single call update, kept until sampled or while immutable
+	std::shared_ptr<std::vector<uint8_t>> _block;
+	bool _immutable = false;
+	bool _hasUploaded = false;
+	bool _explicitMipmaps = false;
+	uint8_t _numMips = 1;
+	bool _sampled = false;
+	bool _mipmapsPending = false;
+	uint32_t _mipmapVersion = 0;
+	EventListener* _backToForegroundListener = nullptr;
+};
+
+/**
+ * Array of 2D textures with the same size and format.
+ * Updates from `Texture2DBackend` interface go to layer 0, use `updateLayer()` for other layers.
+ * Layers are not kept on CPU, they are undefined after the storage is recreated by a change of
+ * mipmaps, size or format.
+ */
+class Texture2DArrayBX : public Texture2DBackend
+{
+public:
+	/**
+	 * @param descriptor Specifies the description of each layer.
+	 * @param numLayers Specifies the number of layers.
+	 */
+	Texture2DArrayBX(const TextureDescriptor& descriptor, uint16_t numLayers);
+	~Texture2DArrayBX();
+
+	void updateData(uint8_t* data, std::size_t width, std::size_t height, std::size_t level) override;
+	void updateCompressedData(uint8_t* data, std::size_t width, std::size_t height, std::size_t dataLen, std::size_t level) override;
+	void updateSubData(std::size_t xoffset, std::size_t yoffset, std::size_t width, std::size_t height, std::size_t level, uint8_t* data) override;
+	void updateCompressedSubData(std::size_t xoffset, std::size_t yoffset, std::size_t width, std::size_t height, std::size_t dataLen, std::size_t level, uint8_t* data) override;
+	void updateSamplerDescriptor(const SamplerDescriptor &sampler) override;
+
+	/**
+	 * Read a block of pixels from layer 0.
+	 */
+	void getBytes(std::size_t x, std::size_t y, std::size_t width, std::size_t height, bool flipImage, std::function<void(const unsigned char*, std::size_t, std::size_t)> callback) override;
+
+	/// Not supported, levels can be given by `updateLayer()` when the array has mipmaps.
+	void generateMipmaps() override;
+
+	void updateTextureDescriptor(const TextureDescriptor& descriptor) override;
+
+	/**
+	 * Update a region of a layer.
+	 * @param layer Specifies the layer.
+	 * @param x,y,width,height Specifies the region.
+	 * @param level Specifies the mip level.
+	 * @param data Specifies a pointer to the image data in memory.
+	 * @param size Specifies the size of data in bytes.
+	 */
+	void updateLayer(uint16_t layer, std::size_t x, std::size_t y, std::size_t width, std::size_t height,
+		std::size_t level, const uint8_t* data, std::size_t size);
+
+	bgfx::TextureHandle getHandle() const { return _handle; }
+	/**
+	 * Set texture to pipeline
+	 * @param index Specifies the texture image unit selector.
+	 */
+	bgfx::TextureHandle apply(int index);
+
+	uint16_t getNumLayers() const { return _numLayers; }
 	uint32_t getSamplerFlag() const { return _sampler; }
-	bool isSamplerChanged() const { return _samplerChanged; }
 	void getSize(uint32_t& width, uint32_t& height) const { width = _width; height = _height; }
 
 private:
@@ -182,8 +387,8 @@ private:
 
 	bgfx::TextureHandle _handle;
 	bgfx::TextureFormat::Enum _format = bgfx::TextureFormat::RGBA8;
+	uint16_t _numLayers = 1;
 	uint32_t _sampler = 0;
-	bool _samplerChanged = false;
 	bool _isPow2 = false;
 	bool _dirty = true;
 	EventListener* _backToForegroundListener = nullptr;
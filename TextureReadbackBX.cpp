@@ -0,0 +1,129 @@
+#include "TextureReadbackBX.h"
+#include "ImageUtilsBX.h"
+#include "UtilsBX.h"
+#include "bimg/bimg.h"
+#include "base/CCDirector.h"
+
+using namespace bgfx;
+
+CC_BACKEND_BEGIN
+
+TextureReadbackBX* TextureReadbackBX::getInstance()
+{
+	static TextureReadbackBX ins;
+	return &ins;
+}
+
+TextureReadbackBX::~TextureReadbackBX()
+{
+	_pending.clear();
+	for (auto& target : _pool)
+	{
+		if (isValid(target.handle))
+			destroy(target.handle);
+	}
+	_pool.clear();
+}
+
+void TextureReadbackBX::read(TextureHandle texture, uint32_t textureWidth, uint32_t textureHeight,
+	TextureFormat::Enum format, uint16_t layer,
+	uint32_t x, uint32_t y, uint32_t width, uint32_t height, bool flipImage,
+	const Callback& callback)
+{
+	if (!callback)
+		return;
+	const auto bitsPerPixel = bimg::getBitsPerPixel(bimg::TextureFormat::Enum(format));
+	if (width == 0 || height == 0 || x + width > textureWidth || y + height > textureHeight
+		|| !isValid(texture) || bimg::isCompressed(bimg::TextureFormat::Enum(format))
+		|| !(getCaps()->supported & BGFX_CAPS_TEXTURE_READ_BACK))
+	{
+		callback(nullptr, 0, 0);
+		return;
+	}
+	auto request = std::make_shared<Request>();
+	request->target = acquire(width, height, format);
+	request->width = width;
+	request->height = height;
+	request->pitch = width * bitsPerPixel / 8;
+	request->data.resize(size_t(request->pitch) * height);
+	request->flipImage = flipImage;
+	request->callback = callback;
+	_pending.push_back(request);
+
+	// only the region is copied, the blit runs after all views of the frame
+	const auto dst = _pool[request->target].handle;
+	addThreadTask([=]()
+	{
+		const ViewId view = ViewId(getCaps()->limits.maxViews - 1);
+		blit(view, dst, 0, 0, 0, 0, texture, 0, uint16_t(x), uint16_t(y), layer, uint16_t(width), uint16_t(height));
+		request->readyFrame = readTexture(dst, request->data.data());
+	});
+}
+
+void TextureReadbackBX::process()
+{
+	const auto frame = Director::getInstance()->getTotalFrames();
+	const auto bgfxFrame = UtilsBX::getFrameNumber();
+	for (auto it = _pending.begin(); it != _pending.end();)
+	{
+		auto& request = **it;
+		// bgfx writes into the request until then, so it can't be dropped earlier
+		const auto readyFrame = request.readyFrame.load();
+		if (readyFrame == 0 || bgfxFrame < readyFrame)
+		{
+			++it;
+			continue;
+		}
+		if (request.flipImage)
+			ImageUtilsBX::flipRows(request.data.data(), request.pitch, request.height);
+		request.callback(request.data.data(), request.width, request.height);
+		auto& target = _pool[request.target];
+		target.inUse = false;
+		target.lastUse = frame;
+		it = _pending.erase(it);
+	}
+	// pool is small, indices of targets in use must stay valid
+	for (auto& target : _pool)
+	{
+		if (!target.inUse && isValid(target.handle) && frame - target.lastUse > _maxIdleFrames)
+		{
+			destroy(target.handle);
+			target.handle = BGFX_INVALID_HANDLE;
+		}
+	}
+}
+
+size_t TextureReadbackBX::acquire(uint32_t width, uint32_t height, TextureFormat::Enum format)
+{
+	const auto frame = Director::getInstance()->getTotalFrames();
+	size_t freeSlot = _pool.size();
+	for (size_t i = 0; i < _pool.size(); ++i)
+	{
+		auto& target = _pool[i];
+		if (target.inUse)
+			continue;
+		if (isValid(target.handle) && target.width == width && target.height == height && target.format == format)
+		{
+			target.inUse = true;
+			target.lastUse = frame;
+			++_poolHits;
+			return i;
+		}
+		if (!isValid(target.handle) && freeSlot == _pool.size())
+			freeSlot = i;
+	}
+	++_poolMisses;
+	if (freeSlot == _pool.size())
+		_pool.emplace_back();
+	auto& target = _pool[freeSlot];
+	target.handle = createTexture2D(uint16_t(width), uint16_t(height), false, 1, format,
+		BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK);
+	target.width = width;
+	target.height = height;
+	target.format = format;
+	target.lastUse = frame;
+	target.inUse = true;
+	return freeSlot;
+}
+
+CC_BACKEND_END
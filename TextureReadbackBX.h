@@ -0,0 +1,88 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include "bgfx/bgfx.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+CC_BACKEND_BEGIN
+
+/**
+ * Reads texture regions back to CPU asynchronously.
+ * Regions are blitted into pooled read back textures and completed in `process()`
+ * once bgfx reached the frame returned by `bgfx::readTexture`.
+ */
+class TextureReadbackBX
+{
+public:
+	using Callback = std::function<void(const unsigned char*, std::size_t, std::size_t)>;
+
+	static TextureReadbackBX* getInstance();
+	~TextureReadbackBX();
+
+	/**
+	 * Queue a read of a texture region, callback receives null if the request is invalid.
+	 * @param texture Specifies the source texture.
+	 * @param textureWidth,textureHeight Specifies size of the source texture.
+	 * @param format Specifies format of the source texture, must not be compressed.
+	 * @param layer Specifies the layer or cube face.
+	 * @param x,y,width,height Specifies the region.
+	 * @param flipImage Specifies if rows should be flipped.
+	 * @param callback Specifies the function to receive pixels, invoked on main thread.
+	 */
+	void read(bgfx::TextureHandle texture, uint32_t textureWidth, uint32_t textureHeight,
+		bgfx::TextureFormat::Enum format, uint16_t layer,
+		uint32_t x, uint32_t y, uint32_t width, uint32_t height, bool flipImage,
+		const Callback& callback);
+
+	/**
+	 * Complete finished reads and release idle pooled textures.
+	 * Should be invoked once per frame.
+	 */
+	void process();
+
+	/** Number of reads in flight. */
+	size_t getPendingCount() const { return _pending.size(); }
+	/** Number of pooled textures, including those in use. */
+	size_t getPoolSize() const { return _pool.size(); }
+	/** Number of reads served by a pooled texture. */
+	size_t getPoolHits() const { return _poolHits; }
+	/** Number of reads which created a texture. */
+	size_t getPoolMisses() const { return _poolMisses; }
+
+private:
+	TextureReadbackBX() = default;
+
+	struct Target
+	{
+		bgfx::TextureHandle handle = BGFX_INVALID_HANDLE;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		bgfx::TextureFormat::Enum format = bgfx::TextureFormat::RGBA8;
+		uint32_t lastUse = 0;
+		bool inUse = false;
+	};
+	struct Request
+	{
+		size_t target = 0;
+		std::vector<uint8_t> data;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t pitch = 0;
+		bool flipImage = false;
+		Callback callback;
+		// written on bgfx thread
+		std::atomic<uint32_t> readyFrame{ 0 };
+	};
+
+	size_t acquire(uint32_t width, uint32_t height, bgfx::TextureFormat::Enum format);
+
+	std::vector<Target> _pool;
+	std::vector<std::shared_ptr<Request>> _pending;
+	size_t _poolHits = 0;
+	size_t _poolMisses = 0;
+	uint32_t _maxIdleFrames = 300;
+};
+
+CC_BACKEND_END
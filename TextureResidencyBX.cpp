@@ -0,0 +1,152 @@
+#include "TextureResidencyBX.h"
+#include "TextureBX.h"
+#include "UtilsBX.h"
+#include "platform/CCImage.h"
+#include "renderer/backend/PixelFormatUtils.h"
+#include "base/CCDirector.h"
+#include "base/CCScheduler.h"
+#include <algorithm>
+#include <vector>
+
+CC_BACKEND_BEGIN
+
+namespace
+{
+	bool uploadImage(Texture2DBX* texture, Image* image)
+	{
+		uint32_t width, height;
+		texture->getSize(width, height);
+		if (uint32_t(image->getWidth()) != width || uint32_t(image->getHeight()) != height
+			|| image->isCompressed() || image->getNumberOfMipmaps() > 1)
+			return false;
+		const auto format = texture->getTextureFormat();
+		auto data = image->getData();
+		unsigned char* converted = nullptr;
+		size_t convertedLen = 0;
+		const auto outFormat = PixelFormatUtils::convertDataToFormat(data, image->getDataLen(),
+			image->getPixelFormat(), format, &converted, &convertedLen);
+		if (outFormat == format)
+			texture->updateData(converted, width, height, 0);
+		if (converted != data)
+			free(converted);
+		return outFormat == format;
+	}
+}
+
+TextureResidencyBX* TextureResidencyBX::getInstance()
+{
+	static TextureResidencyBX ins;
+	return &ins;
+}
+
+void TextureResidencyBX::track(TextureBackend* texture, uint64_t bytes, Category category)
+{
+	auto it = _records.find(texture);
+	if (it == _records.end())
+	{
+		Record record;
+		record.category = category;
+		it = _records.emplace(texture, record).first;
+		_stats[size_t(category)].count++;
+	}
+	auto& record = it->second;
+	auto& stats = _stats[size_t(record.category)];
+	stats.bytes = stats.bytes - record.bytes + bytes;
+	_totalBytes = _totalBytes - record.bytes + bytes;
+	record.bytes = bytes;
+}
+
+void TextureResidencyBX::untrack(TextureBackend* texture)
+{
+	const auto it = _records.find(texture);
+	if (it == _records.end())
+		return;
+	auto& stats = _stats[size_t(it->second.category)];
+	stats.count--;
+	stats.bytes -= it->second.bytes;
+	_totalBytes -= it->second.bytes;
+	_records.erase(it);
+}
+
+void TextureResidencyBX::setCategory(TextureBackend* texture, Category category)
+{
+	auto it = _records.find(texture);
+	if (it == _records.end())
+	{
+		track(texture, 0, category);
+		return;
+	}
+	auto& record = it->second;
+	auto& from = _stats[size_t(record.category)];
+	auto& to = _stats[size_t(category)];
+	from.count--;
+	from.bytes -= record.bytes;
+	to.count++;
+	to.bytes += record.bytes;
+	record.category = category;
+}
+
+void TextureResidencyBX::setFileSource(Texture2DBX* texture, const std::string& path)
+{
+	if (!texture || path.empty())
+		return;
+	bool isCompressed = false;
+	UtilsBX::toBXTextureFormat(texture->getTextureFormat(), &isCompressed);
+	if (isCompressed)
+		return;
+	texture->setReloader([path](Texture2DBX* tex)
+	{
+		tex->retain();
+		addWorkerTask([=]()
+		{
+			auto image = new (std::nothrow) Image();
+			const bool loaded = image && image->initWithImageFile(path);
+			Director::getInstance()->getScheduler()->performFunctionInCocosThread([=]()
+			{
+				if (!loaded || !uploadImage(tex, image))
+				{
+					CCLOG("TextureResidencyBX: failed to reload %s", path.c_str());
+					// it can't come back again, so don't evict it any more
+					tex->_reloader = nullptr;
+				}
+				tex->_reloading = false;
+				CC_SAFE_RELEASE(image);
+				tex->release();
+			});
+		});
+	});
+}
+
+void TextureResidencyBX::process()
+{
+	_evictedLastFrame = 0;
+	if (_budget == 0 || _totalBytes <= _budget)
+		return;
+	const auto frame = Director::getInstance()->getTotalFrames();
+	std::vector<Texture2DBX*> candidates;
+	for (auto& it : _records)
+	{
+		if (it.second.bytes == 0)
+			continue;
+		auto texture = dynamic_cast<Texture2DBX*>(it.first);
+		if (texture && texture->isEvictable() && frame - texture->getLastUse() >= _minIdleFrames)
+			candidates.push_back(texture);
+	}
+	std::sort(candidates.begin(), candidates.end(), [](Texture2DBX* a, Texture2DBX* b)
+	{
+		return a->getLastUse() < b->getLastUse();
+	});
+	for (auto texture : candidates)
+	{
+		if (_totalBytes <= _budget)
+			break;
+		const auto record = _records[texture];
+		texture->evict();
+		auto& stats = _stats[size_t(record.category)];
+		stats.evictions++;
+		stats.evictedBytes += record.bytes;
+		++_evictedLastFrame;
+	}
+}
+
+CC_BACKEND_END
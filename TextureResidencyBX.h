@@ -0,0 +1,99 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include <array>
+#include <string>
+#include <unordered_map>
+
+CC_BACKEND_BEGIN
+
+class TextureBackend;
+class Texture2DBX;
+
+/**
+ * Accounts GPU memory of textures and keeps it under a budget by evicting
+ * least recently used textures which can be reloaded.
+ * Evicted textures are reloaded through the upload path when they are applied again.
+ */
+class TextureResidencyBX
+{
+public:
+	enum class Category
+	{
+		TEXTURE_2D,
+		TEXTURE_CUBE,
+		RENDER_TARGET,
+		ATLAS,
+		COUNT
+	};
+
+	struct Stats
+	{
+		/** Number of textures. */
+		size_t count = 0;
+		/** Bytes of resident textures. */
+		uint64_t bytes = 0;
+		/** Number of evictions since start. */
+		size_t evictions = 0;
+		/** Bytes freed by evictions since start. */
+		uint64_t evictedBytes = 0;
+	};
+
+	static TextureResidencyBX* getInstance();
+
+	/**
+	 * Set size of a texture, the category is only used when texture is not tracked yet.
+	 * @param texture Specifies the texture.
+	 * @param bytes Specifies the storage size, 0 if texture is evicted.
+	 * @param category Specifies the category of the texture.
+	 */
+	void track(TextureBackend* texture, uint64_t bytes, Category category);
+	void untrack(TextureBackend* texture);
+	void setCategory(TextureBackend* texture, Category category);
+
+	/**
+	 * Make a texture reloadable from an image file, so that it can be evicted.
+	 * @param texture Specifies the texture, must be created from the file.
+	 * @param path Specifies full path of the file.
+	 */
+	static void setFileSource(Texture2DBX* texture, const std::string& path);
+
+	/**
+	 * Evict textures if over budget.
+	 * Should be invoked once per frame.
+	 */
+	void process();
+
+	/**
+	 * Set budget of texture memory in bytes, 0 means no limit.
+	 */
+	void setBudget(uint64_t bytes) { _budget = bytes; }
+	uint64_t getBudget() const { return _budget; }
+	/** Textures used within this number of frames are not evicted. */
+	void setMinIdleFrames(uint32_t frames) { _minIdleFrames = frames; }
+	uint32_t getMinIdleFrames() const { return _minIdleFrames; }
+
+	uint64_t getTotalBytes() const { return _totalBytes; }
+	const Stats& getStats(Category category) const { return _stats[size_t(category)]; }
+	size_t getEvictionsLastFrame() const { return _evictedLastFrame; }
+	size_t getReloadsTotal() const { return _reloadsTotal; }
+
+private:
+	TextureResidencyBX() = default;
+
+	struct Record
+	{
+		uint64_t bytes = 0;
+		Category category = Category::TEXTURE_2D;
+	};
+
+	std::unordered_map<TextureBackend*, Record> _records;
+	std::array<Stats, size_t(Category::COUNT)> _stats;
+	uint64_t _totalBytes = 0;
+	uint64_t _budget = 0;
+	uint32_t _minIdleFrames = 60;
+	size_t _evictedLastFrame = 0;
+	size_t _reloadsTotal = 0;
+	friend class Texture2DBX;
+};
+
+CC_BACKEND_END
@@ -0,0 +1,300 @@
+#include "TextureTranscoderBX.h"
+#include "DeviceInfoBX.h"
+#include "renderer/backend/Device.h"
+#include "bimg/bimg.h"
+#include "bimg/decode.h"
+#include "bimg/encode.h"
+#include "bx/allocator.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSCODER_USE_SSE2 1
+#else
+#define TRANSCODER_USE_SSE2 0
+#endif
+
+CC_BACKEND_BEGIN
+
+namespace
+{
+	bx::AllocatorI* getAllocator()
+	{
+		static bx::DefaultAllocator allocator;
+		return &allocator;
+	}
+	bool hasAlpha(bgfx::TextureFormat::Enum format)
+	{
+		switch (format)
+		{
+		case bgfx::TextureFormat::BC2:
+		case bgfx::TextureFormat::BC3:
+		case bgfx::TextureFormat::BC7:
+		case bgfx::TextureFormat::ETC2A:
+		case bgfx::TextureFormat::ETC2A1:
+		case bgfx::TextureFormat::PTC12A:
+		case bgfx::TextureFormat::PTC14A:
+		case bgfx::TextureFormat::PTC22:
+		case bgfx::TextureFormat::PTC24:
+		case bgfx::TextureFormat::ATCE:
+		case bgfx::TextureFormat::ATCI:
+			return true;
+		default: ;
+		}
+		return bgfx::TextureFormat::ASTC4x4 <= format && format <= bgfx::TextureFormat::ASTC8x6;
+	}
+	// blocks smaller than the minimum are stored padded
+	void getPaddedSize(bgfx::TextureFormat::Enum format, uint32_t& width, uint32_t& height)
+	{
+		const auto& info = bimg::getBlockInfo(bimg::TextureFormat::Enum(format));
+		const uint32_t bw = info.blockWidth;
+		const uint32_t bh = info.blockHeight;
+		width = std::max<uint32_t>(bw * info.minBlockX, (width + bw - 1) / bw * bw);
+		height = std::max<uint32_t>(bh * info.minBlockY, (height + bh - 1) / bh * bh);
+	}
+	TextureTranscoderBX::FormatPolicy formatPolicy = TextureTranscoderBX::FormatPolicy::LOSSLESS;
+	// values of 8 bits channels which survive a round trip through fewer bits
+	struct ExactTable
+	{
+		uint8_t bits4[256];
+		uint8_t bits5[256];
+		uint8_t bits6[256];
+		ExactTable()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				bits4[i] = isExact(i, 15);
+				bits5[i] = isExact(i, 31);
+				bits6[i] = isExact(i, 63);
+			}
+		}
+		static uint8_t isExact(int value, int max)
+		{
+			const int packed = (value * max + 127) / 255;
+			return uint8_t((packed * 255 + max / 2) / max == value);
+		}
+	};
+	const ExactTable& getExactTable()
+	{
+		static ExactTable table;
+		return table;
+	}
+	// each is 1 if every scanned pixel has the property
+	struct PixelScan
+	{
+		uint8_t opaque = 1;
+		uint8_t binaryAlpha = 1;
+		uint8_t exact565 = 1;
+		uint8_t exact5551 = 1;
+		uint8_t exact4444 = 1;
+	};
+#if TRANSCODER_USE_SSE2
+	// lanes of 16 bits whose value survives a round trip through `max` levels, same as `ExactTable::isExact`
+	__m128i exactMask(__m128i v, short max)
+	{
+		const __m128i vmax = _mm_mullo_epi16(v, _mm_set1_epi16(max));
+		// x / 255 is (x + 1 + (x >> 8)) >> 8 in this range
+		const __m128i x = _mm_add_epi16(vmax, _mm_set1_epi16(127));
+		const __m128i packed = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8)), 8);
+		// exact if 0 <= packed * 255 + max / 2 - v * max < max
+		const __m128i d = _mm_sub_epi16(
+			_mm_add_epi16(_mm_mullo_epi16(packed, _mm_set1_epi16(255)), _mm_set1_epi16(short(max / 2))), vmax);
+		return _mm_and_si128(_mm_cmpgt_epi16(d, _mm_set1_epi16(-1)), _mm_cmplt_epi16(d, _mm_set1_epi16(max)));
+	}
+	uint8_t allSet(__m128i mask)
+	{
+		return uint8_t(_mm_movemask_epi8(mask) == 0xffff);
+	}
+	// returns number of pixels scanned
+	size_t scanPixelsSSE2(const uint8_t* data, size_t count, PixelScan& scan)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i full = _mm_set1_epi16(255);
+		// lanes hold r, g, b, a of two pixels
+		const __m128i alpha = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+		const __m128i green = _mm_set_epi16(0, 0, -1, 0, 0, 0, -1, 0);
+		const __m128i color = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+		__m128i opaque = _mm_set1_epi16(-1);
+		__m128i binaryAlpha = opaque;
+		__m128i exact565 = opaque;
+		__m128i exact5551 = opaque;
+		__m128i exact4444 = opaque;
+		const auto scanLanes = [&](__m128i v)
+		{
+			const __m128i is255 = _mm_cmpeq_epi16(v, full);
+			const __m128i is0 = _mm_cmpeq_epi16(v, zero);
+			const __m128i exact5 = exactMask(v, 31);
+			// lanes which a property doesn't check are set
+			opaque = _mm_and_si128(opaque, _mm_or_si128(is255, color));
+			binaryAlpha = _mm_and_si128(binaryAlpha, _mm_or_si128(_mm_or_si128(is255, is0), color));
+			exact565 = _mm_and_si128(exact565, _mm_or_si128(_mm_or_si128(
+				_mm_andnot_si128(green, exact5), _mm_and_si128(green, exactMask(v, 63))), alpha));
+			exact5551 = _mm_and_si128(exact5551, _mm_or_si128(exact5, alpha));
+			exact4444 = _mm_and_si128(exact4444, exactMask(v, 15));
+		};
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128i pixels = _mm_loadu_si128((const __m128i*)(data + i * 4));
+			scanLanes(_mm_unpacklo_epi8(pixels, zero));
+			scanLanes(_mm_unpackhi_epi8(pixels, zero));
+		}
+		scan.opaque &= allSet(opaque);
+		scan.binaryAlpha &= allSet(binaryAlpha);
+		scan.exact565 &= allSet(exact565);
+		scan.exact5551 &= allSet(exact5551);
+		scan.exact4444 &= allSet(exact4444);
+		return i;
+	}
+#endif
+	void scanPixels(const uint8_t* data, size_t count, PixelScan& scan)
+	{
+		size_t i = 0;
+#if TRANSCODER_USE_SSE2
+		i = scanPixelsSSE2(data, count, scan);
+#endif
+		const auto& table = getExactTable();
+		for (; i < count; ++i)
+		{
+			const auto p = data + i * 4;
+			const uint8_t r = p[0], g = p[1], b = p[2], a = p[3];
+			const uint8_t rb5 = table.bits5[r] & table.bits5[b];
+			scan.opaque &= uint8_t(a == 255);
+			scan.binaryAlpha &= uint8_t(a == 0 || a == 255);
+			scan.exact565 &= rb5 & table.bits6[g];
+			scan.exact5551 &= rb5 & table.bits5[g];
+			scan.exact4444 &= table.bits4[r] & table.bits4[g] & table.bits4[b] & table.bits4[a];
+		}
+	}
+}
+
+void TextureTranscoderBX::setFormatPolicy(FormatPolicy policy)
+{
+	formatPolicy = policy;
+}
+
+TextureTranscoderBX::FormatPolicy TextureTranscoderBX::getFormatPolicy()
+{
+	return formatPolicy;
+}
+
+bgfx::TextureFormat::Enum TextureTranscoderBX::getCompactFormat(const uint8_t* data,
+	uint32_t width, uint32_t height)
+{
+	const auto policy = formatPolicy;
+	if (policy == FormatPolicy::NONE || !data || width == 0 || height == 0)
+		return bgfx::TextureFormat::RGBA8;
+	// alpha only or gray images are kept, A8 and R8 sample other channels as zero
+	const bool lossy = policy != FormatPolicy::LOSSLESS;
+	PixelScan scan;
+	const size_t rowSize = size_t(width) * 4;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		// 4 pixels at a time with SSE2
+		scanPixels(data + y * rowSize, width, scan);
+		// nothing left to find under the policy
+		if (policy != FormatPolicy::LOW && !scan.exact4444
+			&& !(scan.opaque && (lossy || scan.exact565)) && !(scan.binaryAlpha && (lossy || scan.exact5551)))
+			return bgfx::TextureFormat::RGBA8;
+	}
+	if (scan.opaque && (lossy || scan.exact565) && DeviceInfoBX::checkFormatNative(bgfx::TextureFormat::R5G6B5))
+		return bgfx::TextureFormat::R5G6B5;
+	if (scan.binaryAlpha && (lossy || scan.exact5551) && DeviceInfoBX::checkFormatNative(bgfx::TextureFormat::RGB5A1))
+		return bgfx::TextureFormat::RGB5A1;
+	if ((scan.exact4444 || policy == FormatPolicy::LOW) && DeviceInfoBX::checkFormatNative(bgfx::TextureFormat::RGBA4))
+		return bgfx::TextureFormat::RGBA4;
+	return bgfx::TextureFormat::RGBA8;
+}
+
+bool TextureTranscoderBX::canStore(const uint8_t* data, uint32_t width, uint32_t height,
+	bgfx::TextureFormat::Enum format)
+{
+	if (format == bgfx::TextureFormat::RGBA8 || !data)
+		return true;
+	const auto policy = formatPolicy;
+	const bool lossy = policy != FormatPolicy::LOSSLESS;
+	PixelScan scan;
+	scanPixels(data, size_t(width) * height, scan);
+	switch (format)
+	{
+	case bgfx::TextureFormat::R5G6B5:
+		return scan.opaque && (lossy || scan.exact565);
+	case bgfx::TextureFormat::RGB5A1:
+		return scan.binaryAlpha && (lossy || scan.exact5551);
+	default:
+		return scan.exact4444 || policy == FormatPolicy::LOW;
+	}
+}
+
+std::vector<uint8_t> TextureTranscoderBX::convert(const uint8_t* data, uint32_t width, uint32_t height,
+	bgfx::TextureFormat::Enum src, bgfx::TextureFormat::Enum dst)
+{
+	std::vector<uint8_t> ret;
+	if (!data || width == 0 || height == 0)
+		return ret;
+	ret.resize(size_t(width) * height * bimg::getBitsPerPixel(bimg::TextureFormat::Enum(dst)) / 8);
+	if (!bimg::imageConvert(getAllocator(), ret.data(), bimg::TextureFormat::Enum(dst),
+		data, bimg::TextureFormat::Enum(src), width, height, 1))
+		ret.clear();
+	return ret;
+}
+
+bgfx::TextureFormat::Enum TextureTranscoderBX::getTargetFormat(bgfx::TextureFormat::Enum format)
+{
+	if (!bimg::isCompressed(bimg::TextureFormat::Enum(format)) || DeviceInfoBX::checkFormatNative(format))
+		return format;
+	const auto target = hasAlpha(format) ? bgfx::TextureFormat::BC3 : bgfx::TextureFormat::BC1;
+	auto deviceInfo = Device::getInstance()->getDeviceInfo();
+	if (deviceInfo->checkForFeatureSupported(FeatureType::S3TC) && DeviceInfoBX::checkFormatNative(target))
+		return target;
+	return bgfx::TextureFormat::RGBA8;
+}
+
+std::vector<uint8_t> TextureTranscoderBX::transcode(const uint8_t* data, size_t size,
+	uint32_t width, uint32_t height,
+	bgfx::TextureFormat::Enum src, bgfx::TextureFormat::Enum dst)
+{
+	std::vector<uint8_t> ret;
+	if (!data || width == 0 || height == 0)
+		return ret;
+	uint32_t srcWidth = width;
+	uint32_t srcHeight = height;
+	getPaddedSize(src, srcWidth, srcHeight);
+	if (size < bimg::imageGetSize(nullptr, uint16_t(srcWidth), uint16_t(srcHeight), 1, false, false, 1,
+		bimg::TextureFormat::Enum(src)))
+		return ret;
+	std::vector<uint8_t> rgba(size_t(srcWidth) * srcHeight * 4);
+	bimg::imageDecodeToRgba8(getAllocator(), rgba.data(), data, srcWidth, srcHeight, srcWidth * 4,
+		bimg::TextureFormat::Enum(src));
+
+	if (dst == bgfx::TextureFormat::RGBA8)
+	{
+		ret.resize(size_t(width) * height * 4);
+		for (uint32_t y = 0; y < height; ++y)
+			memcpy(ret.data() + size_t(y) * width * 4, rgba.data() + size_t(y) * srcWidth * 4, width * 4);
+		return ret;
+	}
+
+	uint32_t dstWidth = width;
+	uint32_t dstHeight = height;
+	getPaddedSize(dst, dstWidth, dstHeight);
+	// source and destination blocks are both 4x4 for formats handled here
+	if (dstWidth > srcWidth || dstHeight > srcHeight)
+		return ret;
+	if (dstWidth != srcWidth)
+	{
+		for (uint32_t y = 1; y < dstHeight; ++y)
+			memmove(rgba.data() + size_t(y) * dstWidth * 4, rgba.data() + size_t(y) * srcWidth * 4, dstWidth * 4);
+	}
+	ret.resize(bimg::imageGetSize(nullptr, uint16_t(dstWidth), uint16_t(dstHeight), 1, false, false, 1,
+		bimg::TextureFormat::Enum(dst)));
+	bx::Error err;
+	bimg::imageEncodeFromRgba8(getAllocator(), ret.data(), rgba.data(), dstWidth, dstHeight, 1,
+		bimg::TextureFormat::Enum(dst), bimg::Quality::Default, &err);
+	if (!err.isOk())
+		ret.clear();
+	return ret;
+}
+
+CC_BACKEND_END
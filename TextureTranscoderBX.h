@@ -0,0 +1,78 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include "bgfx/bgfx.h"
+#include <vector>
+
+CC_BACKEND_BEGIN
+
+/**
+ * Converts compressed texture data which the device can't sample natively,
+ * and picks cheaper formats for uncompressed images under a quality policy.
+ * Conversion is pure CPU work and can run on worker threads.
+ */
+class TextureTranscoderBX
+{
+public:
+	enum class FormatPolicy
+	{
+		/** Keep RGBA8. */
+		NONE,
+		/** Use a 16 bits format only if it represents every pixel exactly. */
+		LOSSLESS,
+		/** Also quantize opaque images to RGB565 and images with binary alpha to RGB5A1. */
+		BALANCED,
+		/** Also quantize other images to RGBA4. */
+		LOW,
+	};
+
+	/** Policy for textures uploaded later, default is `LOSSLESS`. */
+	static void setFormatPolicy(FormatPolicy policy);
+	static FormatPolicy getFormatPolicy();
+
+	/**
+	 * Get a cheaper format to store RGBA8 pixels with under current policy.
+	 * Only formats sampled natively and with the same channel swizzle are chosen.
+	 * @param data Specifies pixels, tightly packed.
+	 * @param width,height Specifies size of image in pixels.
+	 * @return The format to store the image with, RGBA8 if there is no cheaper one.
+	 */
+	static bgfx::TextureFormat::Enum getCompactFormat(const uint8_t* data, uint32_t width, uint32_t height);
+
+	/**
+	 * Check if RGBA8 pixels can be stored in a format from `getCompactFormat` under current policy,
+	 * used for later updates of a compacted texture.
+	 * @param data Specifies pixels, tightly packed.
+	 * @param width,height Specifies size of image in pixels.
+	 * @param format Specifies the format of the texture.
+	 */
+	static bool canStore(const uint8_t* data, uint32_t width, uint32_t height, bgfx::TextureFormat::Enum format);
+
+	/**
+	 * Convert uncompressed pixels between formats.
+	 * @return Converted data, empty if failed.
+	 */
+	static std::vector<uint8_t> convert(const uint8_t* data, uint32_t width, uint32_t height,
+		bgfx::TextureFormat::Enum src, bgfx::TextureFormat::Enum dst);
+
+	/**
+	 * Get the format to create a texture with for data in given format.
+	 * Formats sampled natively are returned as is, other compressed formats become
+	 * BC1/BC3 if S3TC is supported, RGBA8 otherwise.
+	 */
+	static bgfx::TextureFormat::Enum getTargetFormat(bgfx::TextureFormat::Enum format);
+
+	/**
+	 * Transcode an image.
+	 * @param data Specifies source data.
+	 * @param size Specifies size of source data in bytes.
+	 * @param width,height Specifies size of image in pixels.
+	 * @param src Specifies source format.
+	 * @param dst Specifies destination format, should be from `getTargetFormat`.
+	 * @return Converted data, empty if failed.
+	 */
+	static std::vector<uint8_t> transcode(const uint8_t* data, size_t size,
+		uint32_t width, uint32_t height,
+		bgfx::TextureFormat::Enum src, bgfx::TextureFormat::Enum dst);
+};
+
+CC_BACKEND_END
@@ -0,0 +1,173 @@
+#include "TextureUploaderBX.h"
+#include "TextureBX.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace bgfx;
+
+CC_BACKEND_BEGIN
+
+namespace
+{
+	void releaseUploadData(void* ptr, void* /*userData*/)
+	{
+		delete[] static_cast<uint8_t*>(ptr);
+	}
+}
+
+TextureUploaderBX* TextureUploaderBX::getInstance()
+{
+	static TextureUploaderBX ins;
+	return &ins;
+}
+
+TextureUploaderBX::~TextureUploaderBX()
+{
+	for (auto& upload : _queue)
+		delete[] upload.data;
+	_queue.clear();
+}
+
+void TextureUploaderBX::push(Texture2DBX* texture, uint8_t level,
+	uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+	const void* data, uint32_t size, int priority)
+{
+	if (!texture || !data || size == 0)
+		return;
+	Upload upload;
+	upload.texture = texture;
+	upload.data = new uint8_t[size];
+	std::memcpy(upload.data, data, size);
+	upload.size = size;
+	// block compressed rows can't be addressed by pitch
+	if (!texture->_isCompressed && height > 0 && size % height == 0)
+		upload.pitch = size / height;
+	upload.priority = priority;
+	upload.x = x;
+	upload.y = y;
+	upload.width = width;
+	upload.height = height;
+	upload.level = level;
+	// keep FIFO order within same priority
+	const auto it = std::upper_bound(_queue.begin(), _queue.end(), priority,
+		[](int p, const Upload& u) { return p > u.priority; });
+	_queue.insert(it, upload);
+	_queuedBytes += size;
+	texture->_pendingUploads++;
+}
+
+void TextureUploaderBX::cancel(Texture2DBX* texture)
+{
+	for (auto it = _queue.begin(); it != _queue.end();)
+	{
+		if (it->texture == texture)
+		{
+			_queuedBytes -= it->size;
+			delete[] it->data;
+			it = _queue.erase(it);
+		}
+		else
+			++it;
+	}
+	texture->_pendingUploads = 0;
+}
+
+void TextureUploaderBX::flush(Texture2DBX* texture)
+{
+	for (auto it = _queue.begin(); it != _queue.end();)
+	{
+		if (it->texture == texture)
+		{
+			auto upload = *it;
+			it = _queue.erase(it);
+			submit(upload, upload.height);
+		}
+		else
+			++it;
+	}
+}
+
+void TextureUploaderBX::process()
+{
+	uint32_t uploaded = 0;
+	while (!_queue.empty())
+	{
+		auto& upload = _queue.front();
+		const uint32_t remaining = _budget > uploaded ? _budget - uploaded : 0;
+		if (_budget == 0 || upload.size <= remaining)
+		{
+			uploaded += upload.size;
+			auto last = upload;
+			_queue.pop_front();
+			submit(last, last.height);
+			continue;
+		}
+		if (upload.pitch == 0)
+		{
+			// not splittable, submitted alone when nothing else is in this frame
+			if (uploaded == 0)
+			{
+				uploaded += upload.size;
+				auto last = upload;
+				_queue.pop_front();
+				submit(last, last.height);
+			}
+			break;
+		}
+		// rows which fit the remaining budget, the rest waits for next frame
+		const auto rows = std::max<uint32_t>(remaining / upload.pitch, uploaded == 0 ? 1 : 0);
+		if (rows > 0)
+		{
+			uploaded += rows * upload.pitch;
+			submit(upload, uint16_t(rows));
+		}
+		break;
+	}
+	_uploadedLastFrame = uploaded;
+	_uploadedTotal += uploaded;
+}
+
+void TextureUploaderBX::submit(Upload& upload, uint16_t rows)
+{
+	auto texture = upload.texture;
+	if (rows >= upload.height)
+	{
+		// last band, data is released once bgfx consumed it
+		_queuedBytes -= upload.size;
+		texture->_pendingUploads--;
+		const Memory* mem;
+		if (upload.offset == 0)
+			mem = makeRef(upload.data, upload.size, releaseUploadData);
+		else
+		{
+			mem = copy(upload.data + upload.offset, upload.size);
+			delete[] upload.data;
+		}
+		texture->updateData(upload.x, upload.y, upload.width, upload.height, upload.level, mem);
+		upload.data = nullptr;
+		upload.size = 0;
+		upload.height = 0;
+		return;
+	}
+	const auto size = rows * upload.pitch;
+	texture->updateData(upload.x, upload.y, upload.width, rows, upload.level,
+		copy(upload.data + upload.offset, size));
+	upload.offset += size;
+	upload.size -= size;
+	upload.y += rows;
+	upload.height -= rows;
+	_queuedBytes -= size;
+}
+
+TextureHandle TextureUploaderBX::getPlaceholder()
+{
+	if (!isValid(_placeholder))
+	{
+		const uint32_t transparent = 0;
+		_placeholder = createTexture2D(1, 1, false, 1, TextureFormat::RGBA8,
+			BGFX_SAMPLER_POINT, copy(&transparent, sizeof(transparent)));
+	}
+	return _placeholder;
+}
+
+CC_BACKEND_END
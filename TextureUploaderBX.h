@@ -0,0 +1,111 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include "bgfx/bgfx.h"
+#include <deque>
+
+CC_BACKEND_BEGIN
+
+class Texture2DBX;
+
+/**
+ * Spreads texture uploads across frames under a bytes-per-frame budget.
+ * Uploads are submitted in priority order, higher priority first.
+ * Uncompressed uploads larger than the budget are submitted in bands of rows.
+ */
+class TextureUploaderBX
+{
+public:
+	static TextureUploaderBX* getInstance();
+	~TextureUploaderBX();
+
+	/**
+	 * Queue an upload of a texture region, data is copied.
+	 * @param texture Specifies the destination texture.
+	 * @param level Specifies the mip level.
+	 * @param x,y,width,height Specifies the region.
+	 * @param data Specifies a pointer to the image data in memory.
+	 * @param size Specifies the size of data in bytes.
+	 * @param priority Specifies the priority of the upload.
+	 */
+	void push(Texture2DBX* texture, uint8_t level,
+		uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+		const void* data, uint32_t size, int priority);
+
+	/**
+	 * Remove all queued uploads of a texture.
+	 * @param texture Specifies the texture.
+	 */
+	void cancel(Texture2DBX* texture);
+
+	/**
+	 * Submit all queued uploads of a texture now, regardless of the budget.
+	 * @param texture Specifies the texture.
+	 */
+	void flush(Texture2DBX* texture);
+
+	/**
+	 * Submit queued uploads until the budget of this frame is used up.
+	 * Should be invoked once per frame. An upload which does not fit is split into bands of rows,
+	 * the rest is kept for next frame. At least one row is submitted if queue is not empty.
+	 */
+	void process();
+
+	/**
+	 * Set upload budget in bytes per frame, 0 means uploads are not queued. Default is 2 MB.
+	 */
+	void setBudget(uint32_t bytesPerFrame) { _budget = bytesPerFrame; }
+	uint32_t getBudget() const { return _budget; }
+	/**
+	 * First uploads smaller than this are submitted at once instead of being streamed,
+	 * so small textures never show the placeholder. Default is 256 KB.
+	 */
+	void setStreamThreshold(uint32_t bytes) { _streamThreshold = bytes; }
+	uint32_t getStreamThreshold() const { return _streamThreshold; }
+
+	/** Number of queued uploads. */
+	size_t getQueueDepth() const { return _queue.size(); }
+	/** Bytes of queued uploads. */
+	uint64_t getQueuedBytes() const { return _queuedBytes; }
+	/** Bytes submitted in last `process()`. */
+	uint32_t getBytesUploadedLastFrame() const { return _uploadedLastFrame; }
+	/** Bytes submitted since start. */
+	uint64_t getBytesUploadedTotal() const { return _uploadedTotal; }
+
+	/**
+	 * Get the texture bound in place of textures which are not resident.
+	 */
+	bgfx::TextureHandle getPlaceholder();
+
+private:
+	TextureUploaderBX() = default;
+
+	struct Upload
+	{
+		Texture2DBX* texture = nullptr;
+		uint8_t* data = nullptr;
+		// offset of remaining rows in data
+		uint32_t offset = 0;
+		// size of remaining rows
+		uint32_t size = 0;
+		// bytes per row, 0 if the upload can't be split
+		uint32_t pitch = 0;
+		int priority = 0;
+		uint16_t x = 0;
+		uint16_t y = 0;
+		uint16_t width = 0;
+		uint16_t height = 0;
+		uint8_t level = 0;
+	};
+
+	void submit(Upload& upload, uint16_t rows);
+
+	std::deque<Upload> _queue;
+	uint32_t _budget = 2 * 1024 * 1024;
+	uint32_t _streamThreshold = 256 * 1024;
+	uint64_t _queuedBytes = 0;
+	uint32_t _uploadedLastFrame = 0;
+	uint64_t _uploadedTotal = 0;
+	bgfx::TextureHandle _placeholder = BGFX_INVALID_HANDLE;
+};
+
+CC_BACKEND_END
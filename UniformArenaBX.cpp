@@ -0,0 +1,128 @@
+#include "UniformArenaBX.h"
+#include "UtilsBX.h"
+#include <algorithm>
+#include <cstdint>
+
+CC_BACKEND_BEGIN
+
+namespace
+{
+	constexpr size_t BLOCK_SIZE = 64 * 1024;
+	constexpr size_t ALIGNMENT = 16;
+}
+
+struct UniformArenaBX::Arena
+{
+	std::vector<std::unique_ptr<char[]>> blocks;
+	std::vector<size_t> blockSizes;
+	size_t block = 0;
+	size_t offset = 0;
+	size_t used = 0;
+
+	char* allocate(size_t size)
+	{
+		size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+		used += size;
+		for (; block < blocks.size(); ++block, offset = 0)
+		{
+			if (offset + size <= blockSizes[block])
+			{
+				const auto ptr = align(blocks[block].get()) + offset;
+				offset += size;
+				return ptr;
+			}
+		}
+		// blocks are never moved, so earlier allocations stay valid
+		const auto blockSize = std::max(BLOCK_SIZE, size);
+		blocks.emplace_back(new char[blockSize + ALIGNMENT]);
+		blockSizes.push_back(blockSize);
+		block = blocks.size() - 1;
+		offset = size;
+		return align(blocks.back().get());
+	}
+
+	void reset()
+	{
+		block = 0;
+		offset = 0;
+		used = 0;
+	}
+
+	size_t getCapacity() const
+	{
+		size_t capacity = 0;
+		for (auto size : blockSizes)
+			capacity += size;
+		return capacity;
+	}
+
+	// offsets are relative to the aligned start of a block
+	static char* align(char* ptr)
+	{
+		return (char*)((uintptr_t(ptr) + ALIGNMENT - 1) & ~uintptr_t(ALIGNMENT - 1));
+	}
+};
+
+UniformArenaBX* UniformArenaBX::getInstance()
+{
+	static UniformArenaBX ins;
+	return &ins;
+}
+
+UniformArenaBX::~UniformArenaBX()
+{
+	for (auto arena : _arenas)
+		delete arena;
+}
+
+char* UniformArenaBX::allocate(size_t size)
+{
+	if (!_current)
+		_current = acquire();
+	return _current->allocate(size);
+}
+
+void UniformArenaBX::endFrame()
+{
+	if (!_current)
+		return;
+	const auto arena = _current;
+	_current = nullptr;
+	// render thread runs tasks in order, so all tasks reading this frame are done
+	addThreadTask([=]()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_free.push_back(arena);
+	});
+}
+
+size_t UniformArenaBX::getFrameSize() const
+{
+	return _current ? _current->used : 0;
+}
+
+size_t UniformArenaBX::getCapacity() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	size_t capacity = 0;
+	for (auto arena : _arenas)
+		capacity += arena->getCapacity();
+	return capacity;
+}
+
+UniformArenaBX::Arena* UniformArenaBX::acquire()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!_free.empty())
+	{
+		const auto arena = _free.back();
+		_free.pop_back();
+		arena->reset();
+		return arena;
+	}
+	const auto arena = new Arena();
+	_arenas.push_back(arena);
+	return arena;
+}
+
+CC_BACKEND_END
@@ -0,0 +1,52 @@
+#pragma once
+#include "renderer/backend/Macros.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+CC_BACKEND_BEGIN
+
+/**
+ * Linear memory for data of draws recorded on the main thread and read by render thread tasks.
+ * Memory of a frame is released at once when the render thread has run all tasks of the frame,
+ * and is reused by a later frame, so recording doesn't allocate once capacity is reached.
+ */
+class UniformArenaBX
+{
+public:
+	static UniformArenaBX* getInstance();
+	~UniformArenaBX();
+
+	/**
+	 * Allocate memory which stays valid until tasks of the current frame are done.
+	 * Should be invoked on the main thread.
+	 * @param size Specifies the size in bytes.
+	 * @return Memory aligned to 16 bytes.
+	 */
+	char* allocate(size_t size);
+
+	/**
+	 * End the current frame, its memory is released after tasks added before.
+	 * Should be invoked once per frame.
+	 */
+	void endFrame();
+
+	/** Bytes allocated in the current frame. */
+	size_t getFrameSize() const;
+	/** Bytes held by all frames. */
+	size_t getCapacity() const;
+
+private:
+	UniformArenaBX() = default;
+
+	struct Arena;
+
+	Arena* acquire();
+
+	mutable std::mutex _mutex;
+	std::vector<Arena*> _arenas;
+	std::vector<Arena*> _free;
+	Arena* _current = nullptr;
+};
+
+CC_BACKEND_END
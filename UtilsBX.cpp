@@ -1,6 +1,10 @@
 #include "UtilsBX.h"
 #include "CCConsole.h"
 #include <map>
+#include <array>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
 CC_BACKEND_BEGIN
 
@@ -150,6 +154,64 @@ bgfx::VertexLayout UtilsBX::toBXVertexLayout(const VertexLayout& vertexLayout)
 	return ret;
 }
 
+namespace
+{
+	// stride followed by attributes packed as offset(16) | format(8) | attrib(7) | normalized(1), sorted by offset
+	using VertexLayoutKey = std::array<uint32_t, bgfx::Attrib::Count + 1>;
+	struct VertexLayoutKeyHash
+	{
+		std::size_t operator()(const VertexLayoutKey& key) const noexcept
+		{
+			uint64_t h = 14695981039346656037ull;
+			for (auto v : key)
+				h = (h ^ v) * 1099511628211ull;
+			return std::size_t(h);
+		}
+	};
+	struct VertexLayoutCacheEntry
+	{
+		bgfx::VertexLayout layout;
+		bgfx::VertexLayoutHandle handle = BGFX_INVALID_HANDLE;
+	};
+	std::unordered_map<VertexLayoutKey, VertexLayoutCacheEntry, VertexLayoutKeyHash> vertexLayoutCache;
+
+	VertexLayoutKey getVertexLayoutKey(const VertexLayout& vertexLayout)
+	{
+		VertexLayoutKey key{};
+		key[0] = (uint32_t)vertexLayout.getStride();
+		size_t num = 0;
+		for (auto& it : vertexLayout.getAttributes())
+		{
+			if (num + 1 >= key.size())
+				break;
+			const auto& attr = it.second;
+			key[++num] = (uint32_t(attr.offset) << 16)
+				| (uint32_t(attr.format) & 0xff) << 8
+				| (uint32_t(UtilsBX::toBXAttrib(attr.name)) & 0x7f) << 1
+				| (attr.needToBeNormallized ? 1 : 0);
+		}
+		std::sort(key.begin() + 1, key.begin() + 1 + num);
+		return key;
+	}
+}
+
+const bgfx::VertexLayout& UtilsBX::getBXVertexLayout(const VertexLayout& vertexLayout,
+	bgfx::VertexLayoutHandle* handle)
+{
+	const auto key = getVertexLayoutKey(vertexLayout);
+	auto it = vertexLayoutCache.find(key);
+	if (it == vertexLayoutCache.end())
+	{
+		VertexLayoutCacheEntry entry;
+		entry.layout = toBXVertexLayout(vertexLayout);
+		entry.handle = bgfx::createVertexLayout(entry.layout);
+		it = vertexLayoutCache.emplace(key, entry).first;
+	}
+	if (handle)
+		*handle = it->second.handle;
+	return it->second.layout;
+}
+
 bgfx::TextureFormat::Enum UtilsBX::toBXTextureFormat(PixelFormat pixelFormat, bool* isCompressed)
 {
 	if (isCompressed)
@@ -475,6 +537,7 @@ uint32_t UtilsBX::toBXSampler(const SamplerDescriptor& samplerDescriptor, bool h
 namespace
 {
 	bgfx::ViewId CURRENT_VIEW = 0;
+	std::atomic<uint32_t> FRAME_NUMBER(0);
 }
 
 void UtilsBX::setCurrentView(bgfx::ViewId id)
@@ -488,6 +551,16 @@ bgfx::ViewId UtilsBX::getCurrentView()
 	return CURRENT_VIEW;
 }
 
+void UtilsBX::setFrameNumber(uint32_t frame)
+{
+	FRAME_NUMBER = frame;
+}
+
+uint32_t UtilsBX::getFrameNumber()
+{
+	return FRAME_NUMBER;
+}
+
 ThreadPool& getThreadPool()
 {
 	static ThreadPool ins(1);
@@ -505,4 +578,15 @@ void addThreadTaskSync(const std::function<void()>& task)
 	fu.get();
 }
 
+ThreadPool& getWorkerPool()
+{
+	static ThreadPool ins(std::max(std::thread::hardware_concurrency(), 3u) - 2);
+	return ins;
+}
+
+void addWorkerTask(const std::function<void()>& task)
+{
+	getWorkerPool().add_task(task);
+}
+
 CC_BACKEND_END
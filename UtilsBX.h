@@ -17,6 +17,14 @@ public:
 	static bgfx::Attrib::Enum toBXAttrib(const std::string& name);
 	static std::pair<bgfx::AttribType::Enum, uint8_t> toBXAttribType(VertexFormat vertexFormat);
 	static bgfx::VertexLayout toBXVertexLayout(const VertexLayout& vertexLayout);
+	/**
+	 * Get converted layout from a cache keyed by layout contents.
+	 * @param vertexLayout Specifies the engine vertex layout.
+	 * @param handle Receives the registered layout handle if not null.
+	 * @return The converted layout.
+	 */
+	static const bgfx::VertexLayout& getBXVertexLayout(const VertexLayout& vertexLayout,
+		bgfx::VertexLayoutHandle* handle = nullptr);
 
 	static bgfx::TextureFormat::Enum toBXTextureFormat(PixelFormat pixelFormat, bool* isCompressed = nullptr);
 	static uint64_t toBXStatePrimitiveType(PrimitiveType primitiveType);
@@ -50,10 +58,19 @@ public:
 
 	static void setCurrentView(bgfx::ViewId id);
 	static bgfx::ViewId getCurrentView();
+
+	/**
+	 * Frame number returned by the last `bgfx::frame()`, set on the bgfx thread.
+	 */
+	static void setFrameNumber(uint32_t frame);
+	static uint32_t getFrameNumber();
 };
 
 ThreadPool& getThreadPool();
 void addThreadTask(const std::function<void()>& task);
 void addThreadTaskSync(const std::function<void()>& task);
+/** Pool for CPU work that should not block the main thread or bgfx submission. */
+ThreadPool& getWorkerPool();
+void addWorkerTask(const std::function<void()>& task);
 
 CC_BACKEND_END
@@ -543,7 +543,7 @@ void GLViewImpl::swapBuffers()
 		//);
 #endif
 
-		bgfx::frame();
+		backend::UtilsBX::setFrameNumber(bgfx::frame());
 
 		bgfx::reset(frameBufferW, frameBufferH);
 		bgfx::setViewRect(0, 0, 0, frameBufferW, frameBufferH);
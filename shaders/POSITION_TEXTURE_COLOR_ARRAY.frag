@@ -0,0 +1,12 @@
+#pragma once
+
+const char POSITION_TEXTURE_COLOR_ARRAY_frag[] =
+R"($input v_color0, v_texcoord0
+
+SAMPLER2DARRAY(u_texture, 0);
+
+void main()
+{
+    gl_FragColor = v_color0 * texture2DArray(u_texture, v_texcoord0);
+}
+)";